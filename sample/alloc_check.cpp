@@ -0,0 +1,223 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Allocation check (Linux)
+
+  alloc_check [iterations] - Run a client and a server connection over a socketpair and
+                             check that, once warmed up, sending and receiving DATA_FTD
+                             and INPUT messages does not allocate. Exits with 1 if it does.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Zusi3TCP.h"
+#include "FrameReader.h"
+#include "PosixBlockingSocket.h"
+
+static std::atomic<size_t> g_allocations(0);
+
+#ifdef __GLIBC__
+//Also count what the library or the standard library allocate with malloc directly
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+static void* countedMalloc(size_t size)
+{
+	++g_allocations;
+	return __libc_malloc(size);
+}
+
+extern "C" void* malloc(size_t size)
+{
+	return countedMalloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	++g_allocations;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+	++g_allocations;
+	return __libc_realloc(p, size);
+}
+#else
+static void* countedMalloc(size_t size)
+{
+	++g_allocations;
+	return malloc(size);
+}
+#endif
+
+void* operator new(size_t size)
+{
+	if (void* p = countedMalloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return countedMalloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+//Command of a received message, leaving the reader on the command's first attribute
+static uint16_t command(zusi::FrameReader& reader)
+{
+	if (reader.next() && reader.item() == zusi::FrameReader::Item_NodeStart)
+		return reader.id();
+	return 0;
+}
+
+//One round of the steady state: the server sends values, the client answers with an input
+static bool exchange(zusi::ServerConnection& server, zusi::ClientConnection& client, int i)
+{
+	std::pair<zusi::FuehrerstandData, float> pairs[] = {
+		{ zusi::Fs_Geschwindigkeit, static_cast<float>(i) },
+		{ zusi::Fs_DruckBremszylinder, 0.1f * i } };
+	zusi::SifaState sifa;
+	sifa.licht = i % 2 == 0;
+	zusi::FsDataValue values[] = {
+		zusi::FsDataValue(zusi::Fs_Motordrehzahl, 10.0f * i),
+		zusi::FsDataValue(sifa) };
+
+	if (!server.sendData(pairs) || !server.sendData(values) || !server.sendState(values))
+		return false;
+
+	zusi::FrameReader reader;
+	for (int m = 0; m < 3; ++m)
+		if (!client.receiveFrame(reader) || command(reader) != zusi::Cmd_DATA_FTD)
+			return false;
+
+	if (!client.sendInput(zusi::Tt_Fahrschalter, zusi::Tk_FahrschalterAuf_Down, zusi::Ta_Absolut, static_cast<int16_t>(i % 100)))
+		return false;
+
+	return server.receiveFrame(reader) && command(reader) == zusi::Cmd_INPUT;
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		std::cout << "Error creating socketpair" << std::endl;
+		return 1;
+	}
+
+	try {
+		zusi::PosixBlockingSocket server_socket(fds[0]);
+		zusi::PosixBlockingSocket client_socket(fds[1]);
+		zusi::ServerConnection server(&server_socket);
+		zusi::ClientConnection client(&client_socket);
+
+		bool accepted = false;
+		std::thread handshake([&]() { accepted = server.accept(); });
+
+		std::vector<zusi::FuehrerstandData> fd_ids{ zusi::Fs_Geschwindigkeit, zusi::Fs_DruckBremszylinder, zusi::Fs_Motordrehzahl, zusi::Fs_Sifa };
+		std::vector<zusi::ProgData> prog_ids;
+		bool connected = client.connect("AllocCheck", fd_ids, prog_ids, true);
+		handshake.join();
+
+		if (!connected || !accepted)
+		{
+			std::cout << "Error connecting" << std::endl;
+			return 1;
+		}
+
+		//Let the receive buffers and the thread's encoder grow to their final size
+		for (int i = 0; i < 100; ++i)
+		{
+			if (!exchange(server, client, i))
+			{
+				std::cout << "Error exchanging messages" << std::endl;
+				return 1;
+			}
+		}
+
+		size_t before = g_allocations;
+		for (int i = 0; i < iterations; ++i)
+		{
+			if (!exchange(server, client, i))
+			{
+				std::cout << "Error exchanging messages" << std::endl;
+				return 1;
+			}
+		}
+		size_t allocations = g_allocations - before;
+
+		std::cout << iterations << " iterations, " << allocations << " allocations" << std::endl;
+		if (allocations != 0)
+			return 1;
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
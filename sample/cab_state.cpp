@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Shared cab state (Linux)
+
+  cab_state publish [address] - Connect to Zusi and publish all received values
+                                 into the shared memory segment /zusi3tcp
+  cab_state read               - Print values from the segment once per second
+*/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Zusi3TCP.h"
+#include "PosixBlockingSocket.h"
+#include "SharedState.h"
+
+static const char* SEGMENT_NAME = "/zusi3tcp";
+
+static int publish(const char* address)
+{
+	zusi::SharedStatePublisher publisher(SEGMENT_NAME);
+
+	zusi::PosixBlockingSocket tcp_socket(address, 1436);
+	zusi::ClientConnection con(&tcp_socket);
+
+	std::vector<zusi::FuehrerstandData> fd_ids{ zusi::Fs_Geschwindigkeit, zusi::Fs_DruckHauptlufleitung, zusi::Fs_DruckBremszylinder,
+		zusi::Fs_DruckHauptluftbehaelter, zusi::Fs_Oberstrom, zusi::Fs_Fahrleitungsspannung, zusi::Fs_Motordrehzahl,
+		zusi::Fs_UhrzeitStunde, zusi::Fs_UhrzeitMinute, zusi::Fs_UhrzeitSekunde, zusi::Fs_Hauptschalter,
+		zusi::Fs_AfbSollGeschwindigkeit, zusi::Fs_AfbEinAus, zusi::Fs_Sifa };
+	std::vector<zusi::ProgData> prog_ids{ zusi::Prog_Zugdatei, zusi::Prog_Zugnummer, zusi::Prog_SimStart, zusi::Prog_BuchfahrplanDatei };
+
+	con.connect("CabState", fd_ids, prog_ids, false, true);
+	std::cout << "Publishing to " << SEGMENT_NAME << std::endl;
+
+	while (true)
+	{
+		zusi::Node msg;
+		if (!con.receiveMessage(msg))
+		{
+			std::cout << "Error receiving message" << std::endl;
+			return 1;
+		}
+
+		publisher.publish(msg);
+	}
+}
+
+static int read()
+{
+	zusi::SharedStateReader reader(SEGMENT_NAME);
+
+	while (true)
+	{
+		float speed = 0.0f, pressure = 0.0f;
+		reader.readFloat(zusi::Fs_Geschwindigkeit, speed);
+		reader.readFloat(zusi::Fs_DruckBremszylinder, pressure);
+
+		std::cout << "Updates: " << reader.updates()
+			<< " Geschwindigkeit: " << speed
+			<< " DruckBremszylinder: " << pressure
+			<< " Zugnummer: " << reader.readProg(zusi::Prog_Zugnummer) << std::endl;
+
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		std::string mode = argc > 1 ? argv[1] : "";
+		if (mode == "publish")
+			return publish(argc > 2 ? argv[2] : "127.0.0.1");
+		if (mode == "read")
+			return read();
+
+		std::cout << "Usage: cab_state publish [address] | cab_state read" << std::endl;
+		return 1;
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
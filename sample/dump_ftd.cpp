@@ -20,96 +20,309 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <vector>
 #include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "Zusi3TCP.h"
-#include "DebugSocket.h"
+#include "AsyncWriter.h"
+#include "Capture.h"
+#include "Dispatcher.h"
+#include "TextFormat.h"
 #include "WinsockBlockingSocket.h"
 
-void parseDataMessage(const zusi::Node& msg)
+/*
+Options:
+  --address ADDRESS  Zusi server to connect to (default 127.0.0.1)
+  --format FORMAT    text (default), csv, ndjson or binary
+  --out FILE         Write to FILE instead of the console
+  ID...              Fuehrerstand IDs to subscribe to and output
+                     (default Geschwindigkeit, Motordrehzahl, DruckBremszylinder)
+
+csv writes a "seconds,id,value" line and ndjson a {"t":seconds,"id":id,"v":value}
+line per value, with seconds since connecting. binary writes the received messages
+in the capture file format (see Capture.h), e.g. for zusi_store.
+
+Output is buffered and written by a separate thread, so receiving and decoding
+never wait for the console or disk.
+*/
+
+enum Format
+{
+	Format_Text,
+	Format_Csv,
+	Format_Ndjson,
+	Format_Binary
+};
+
+//! Time between handing buffered output to the writer thread when little is received
+static const std::chrono::milliseconds FLUSH_INTERVAL(100);
+
+//! Write seconds with microsecond resolution
+static size_t formatSeconds(char* dest, std::chrono::nanoseconds time)
 {
-	if (msg.getId() == zusi::MsgType_Fahrpult)
+	uint64_t micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(time).count());
+
+	size_t length = zusi::text::formatUint(dest, micros / 1000000);
+	dest[length++] = '.';
+
+	uint64_t fraction = micros % 1000000;
+	for (uint64_t digit = 100000; digit > 0; digit /= 10)
+		dest[length++] = static_cast<char>('0' + fraction / digit % 10);
+	return length;
+}
+
+static void appendText(zusi::AsyncWriter& out, const char* text)
+{
+	out.append(text, strlen(text));
+}
+
+//Output the data and keyboard operations received from Zusi
+static void registerHandlers(zusi::Dispatcher& dispatcher, const std::vector<zusi::FuehrerstandData>& fd_ids, zusi::AsyncWriter& out,
+	Format format, const std::chrono::nanoseconds& received)
+{
+	static const size_t LINE_CHARS = 128;
+
+	for (zusi::FuehrerstandData id : fd_ids)
 	{
-		for (const zusi::Node* node : msg.nodes)
+		dispatcher.onFloat(zusi::MsgType_Fahrpult, zusi::Cmd_DATA_FTD, id, [id, &out, format, &received](float value)
 		{
-			if (node->getId() == zusi::Cmd_DATA_FTD)
+			char* line = out.prepare(LINE_CHARS);
+			size_t length = 0;
+
+			switch (format)
 			{
-				for (const zusi::Attribute* att : node->attributes)
+			case Format_Text:
+				memcpy(line, "FS Data ", 8);
+				length = 8;
+				length += zusi::text::formatUint(line + length, id);
+				line[length++] = ':';
+				line[length++] = ' ';
+				length += zusi::text::formatFloat(line + length, value);
+				break;
+			case Format_Csv:
+				length = formatSeconds(line, received);
+				line[length++] = ',';
+				length += zusi::text::formatUint(line + length, id);
+				line[length++] = ',';
+				length += zusi::text::formatFloat(line + length, value);
+				break;
+			case Format_Ndjson:
+				memcpy(line, "{\"t\":", 5);
+				length = 5;
+				length += formatSeconds(line + length, received);
+				memcpy(line + length, ",\"id\":", 6);
+				length += 6;
+				length += zusi::text::formatUint(line + length, id);
+				memcpy(line + length, ",\"v\":", 5);
+				length += 5;
+				//JSON has no infinity or NaN
+				if (std::isfinite(value))
 				{
-					float value = *(reinterpret_cast<float*>(att->data));
-					std::cout << "FS Data " << att->getId() << ": " << value << std::endl;
+					length += zusi::text::formatFloat(line + length, value);
 				}
-			}
-			else if (node->getId() == zusi::Cmd_DATA_OPERATION)
-			{
-				for (const zusi::Node* input : node->nodes)
+				else
 				{
-					if (input->getId() == 1)
-					{
-						std::cout << "Tastur Operation:" << std::endl;
-						for (const zusi::Attribute* att : input->attributes)
-						{
-							if(att->getId() <= 0x3)
-								std::cout << "    Parameter " << att->getId() << " = " << *(reinterpret_cast<uint16_t*>(att->data)) << std::endl;
-							else if(att->getId() == 0x4)
-								std::cout << "    Position = " << *(reinterpret_cast<int16_t*>(att->data)) << std::endl;
-						}
-						
-					}
+					memcpy(line + length, "null", 4);
+					length += 4;
 				}
+				line[length++] = '}';
+				break;
+			case Format_Binary:
+				break;
 			}
-		}
+
+			line[length++] = '\n';
+			out.commit(length);
+		});
 	}
+
+	if (format != Format_Text)
+		return;
+
+	dispatcher.onNode(zusi::MsgType_Fahrpult, zusi::Cmd_DATA_OPERATION, 1, [&out](zusi::FrameReader& input)
+	{
+		appendText(out, "Tastur Operation:\n");
+		while (input.next() && input.item() == zusi::FrameReader::Item_Attribute)
+		{
+			char line[LINE_CHARS];
+			size_t length = 0;
+			if (input.id() <= 0x3)
+			{
+				memcpy(line, "    Parameter ", 14);
+				length = 14;
+				length += zusi::text::formatUint(line + length, input.id());
+				memcpy(line + length, " = ", 3);
+				length += 3;
+				length += zusi::text::formatUint(line + length, input.valueUint16());
+			}
+			else if (input.id() == 0x4)
+			{
+				int16_t position = input.valueInt16();
+				memcpy(line, "    Position = ", 15);
+				length = 15;
+				if (position < 0)
+					line[length++] = '-';
+				length += zusi::text::formatUint(line + length, static_cast<uint64_t>(position < 0 ? -position : position));
+			}
+			else
+			{
+				continue;
+			}
+			line[length++] = '\n';
+			out.append(line, length);
+		}
+	});
+}
+
+//! Append a message to binary output as a capture record
+static void appendRecord(zusi::AsyncWriter& out, const zusi::FrameReader& msg)
+{
+	uint64_t timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	uint32_t bytes = static_cast<uint32_t>(msg.frameBytes());
+
+	char* record = out.prepare(zusi::capture::RECORD_HEADER_BYTES + bytes);
+	memcpy(record, &timestamp_ns, sizeof(timestamp_ns));
+	memcpy(record + sizeof(timestamp_ns), &bytes, sizeof(bytes));
+	memcpy(record + zusi::capture::RECORD_HEADER_BYTES, msg.frame(), bytes);
+	out.commit(zusi::capture::RECORD_HEADER_BYTES + bytes);
 }
 
 int main(int argc, char** argv)
 {
-	//Create a socket for message printing
-	zusi::DebugSocket debug_socket;
+	std::string address = "127.0.0.1";
+	std::string out_name;
+	Format format = Format_Text;
+	std::vector<zusi::FuehrerstandData> fd_ids;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--address" && i + 1 < argc)
+			address = argv[++i];
+		else if (arg == "--out" && i + 1 < argc)
+			out_name = argv[++i];
+		else if (arg == "--format" && i + 1 < argc)
+		{
+			std::string name = argv[++i];
+			if (name == "text")
+				format = Format_Text;
+			else if (name == "csv")
+				format = Format_Csv;
+			else if (name == "ndjson")
+				format = Format_Ndjson;
+			else if (name == "binary")
+				format = Format_Binary;
+			else
+			{
+				std::cerr << "Unknown format " << name << std::endl;
+				return 1;
+			}
+		}
+		else
+			fd_ids.push_back(static_cast<zusi::FuehrerstandData>(atoi(argv[i])));
+	}
+
+	if (fd_ids.empty())
+		fd_ids = { zusi::Fs_Geschwindigkeit, zusi::Fs_Motordrehzahl, zusi::Fs_DruckBremszylinder };
+
+	FILE* file = stdout;
+	if (!out_name.empty())
+	{
+		file = fopen(out_name.c_str(), format == Format_Binary ? "wb" : "w");
+		if (!file)
+		{
+			std::cerr << "Cannot create " << out_name << std::endl;
+			return 1;
+		}
+	}
+#ifdef _WIN32
+	else if (format == Format_Binary)
+		_setmode(_fileno(stdout), _O_BINARY);
+#endif
 
 	//Create connection to server
 	try {
-		zusi::WinsockBlockingSocket tcp_socket("127.0.0.1", 1436);
+		zusi::WinsockBlockingSocket tcp_socket(address.c_str(), 1436);
 	
 		//Subscribe to Fuehrerstand Data
 		zusi::ClientConnection con(&tcp_socket);
-		std::vector<zusi::FuehrerstandData> fd_ids{ zusi::Fs_Geschwindigkeit, zusi::Fs_Motordrehzahl, zusi::Fs_DruckBremszylinder };
 		std::vector<zusi::ProgData> prog_ids{ zusi::Prog_SimStart };
 	
 		//Subscribe to receive status updates about the above variables
 		//Not subscribing to input events
 		con.connect("DumpFtd", fd_ids, prog_ids, true);
 
-		std::cout << "Zusi Version:" << con.getZusiVersion() << std::endl;
-		std::cout << "Connection Info: " << con.getConnectionnfo() << std::endl;
+		//Status goes to stderr, so that it does not mix with the data
+		std::cerr << "Zusi Version:" << con.getZusiVersion() << std::endl;
+		std::cerr << "Connection Info: " << con.getConnectionnfo() << std::endl;
 
-		while (true)
+		zusi::AsyncWriter out(file);
+		if (format == Format_Csv)
+			appendText(out, "seconds,id,value\n");
+		else if (format == Format_Binary)
 		{
-			zusi::Node msg;
-			if (con.receiveMessage(msg))
-			{
-				std::cout << "Received message..." << std::endl;
-				msg.write(debug_socket); //Print data to the console
+			out.append(zusi::capture::MAGIC, sizeof(zusi::capture::MAGIC));
+			out.append(&zusi::capture::VERSION, sizeof(zusi::capture::VERSION));
+		}
 
-				parseDataMessage(msg);
-				std::cout << std::endl;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point last_flush = start;
+		std::chrono::nanoseconds received(0);
+
+		zusi::Dispatcher dispatcher;
+		registerHandlers(dispatcher, fd_ids, out, format, received);
+
+		zusi::FrameReader msg;
+		uint64_t messages = 0;
+		while (con.receiveFrame(msg))
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			received = now - start;
+			++messages;
+
+			if (format == Format_Binary)
+				appendRecord(out, msg);
+			else if (format == Format_Text)
+			{
+				appendText(out, "Received message...\n");
+				dispatcher.dispatch(msg);
+				appendText(out, "\n");
 			}
 			else
+				dispatcher.dispatch(msg);
+
+			//At low rates, show output without waiting for a full buffer
+			if (now - last_flush >= FLUSH_INTERVAL)
 			{
-				std::cout << "Error receiving message" << std::endl;
-				break;
+				out.flush();
+				last_flush = now;
 			}
 		}
 
+		if (!out.finish())
+			std::cerr << "Error writing output" << std::endl;
+		std::cerr << "Connection closed after " << messages << " messages, output waited " << out.waits() << " times" << std::endl;
 	}
 	catch (std::runtime_error& e)
 	{
-		std::cout << "Network error: " << e.what() << std::endl;
+		std::cerr << "Network error: " << e.what() << std::endl;
 		return 1;
 	}
 
+	if (file != stdout)
+		fclose(file);
 
 	return 0;
-}
\ No newline at end of file
+}
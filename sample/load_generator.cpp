@@ -0,0 +1,434 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Zusi server load generator (Linux)
+
+Emulates a Zusi server for any number of clients and sends DATA_FTD messages
+at a configurable rate. Reports the achieved message rate and the CPU time
+spent sending.
+
+Usage: load_generator [options]
+  --port N         Port to listen on (default 1436)
+  --clients N      Stop accepting after N clients (default unlimited, not
+                   used with --shards)
+  --rate HZ        Messages per second sent to each client (default 1000)
+  --vars N         Send Fuehrerstand IDs 1..N in each message (default 16)
+  --profile FILE   Replay values from a CSV file with lines "seconds,id,value"
+                   instead of the synthetic profile. Replay loops at the end.
+  --duration S     Stop after S seconds (default run forever)
+  --uring          Use UringSocket where supported
+  --speed X        Run the value profile X times faster than real time
+  --step           Send as fast as possible, stepping the profile time
+  --full-state     Send every variable the client requested in each message,
+                   patching the new values into a message encoded once
+  --shards N       Serve clients from N epoll threads sharing the port with
+                   SO_REUSEPORT, instead of one thread per client. A single
+                   producer publishes each update to all clients.
+  --queue-bytes N  With --shards: send queue limit per client (default 262144)
+  --queue-policy P With --shards: what to do when a client's queue is full:
+                   coalesce (default), drop-oldest or disconnect
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Zusi3TCP.h"
+#include "Clock.h"
+#include "PosixBlockingSocket.h"
+#include "ShardedServer.h"
+#include "UringSocket.h"
+
+typedef std::vector<std::pair<zusi::FuehrerstandData, float>> Frame;
+
+struct Settings
+{
+	int port = 1436;
+	int clients = -1;
+	double rate = 1000.0;
+	int vars = 16;
+	std::string profile;
+	double duration = -1.0;
+	bool uring = false;
+	double speed = 1.0;
+	bool step = false;
+	bool full_state = false;
+	int shards = 0;
+	size_t queue_bytes = 256 * 1024;
+	zusi::SendQueue::Policy queue_policy = zusi::SendQueue::Policy_Coalesce;
+};
+
+static std::atomic<bool> g_running(true);
+static std::atomic<uint64_t> g_messages(0);
+static std::atomic<int> g_activeClients(0);
+
+//Recorded profile: one frame per distinct time stamp
+static std::vector<Frame> loadProfile(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+		throw std::runtime_error("Unable to open profile " + filename);
+
+	std::vector<Frame> frames;
+	std::string line;
+	double last_time = -1.0;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		double time;
+		int id;
+		float value;
+		char comma1, comma2;
+		if (!(fields >> time >> comma1 >> id >> comma2 >> value))
+			continue;
+
+		if (frames.empty() || time != last_time)
+			frames.push_back(Frame());
+		frames.back().push_back(std::make_pair(static_cast<zusi::FuehrerstandData>(id), value));
+		last_time = time;
+	}
+
+	if (frames.empty())
+		throw std::runtime_error("Profile " + filename + " contains no values");
+
+	return frames;
+}
+
+static void fillSynthetic(Frame& frame, int vars, uint64_t sequence, double rate)
+{
+	double t = sequence / rate;
+	frame.clear();
+	for (int id = 1; id <= vars; ++id)
+		frame.push_back(std::make_pair(static_cast<zusi::FuehrerstandData>(id), static_cast<float>(50.0 + 50.0 * std::sin(0.5 * t + id))));
+}
+
+static std::unique_ptr<zusi::Clock> makeClock(const Settings& settings)
+{
+	std::unique_ptr<zusi::Clock> clock;
+	if (settings.step)
+		clock.reset(new zusi::SteppedClock());
+	else if (settings.speed != 1.0)
+		clock.reset(new zusi::ScaledClock(settings.speed));
+	else
+		clock.reset(new zusi::SystemClock());
+	return clock;
+}
+
+static void serveClient(int client_fd, const Settings& settings, const std::vector<Frame>* profile)
+{
+	try
+	{
+		std::unique_ptr<zusi::Socket> socket;
+		if (settings.uring && zusi::UringSocket::isSupported())
+		{
+			try
+			{
+				socket.reset(new zusi::UringSocket(client_fd));
+			}
+			catch (std::runtime_error&)
+			{
+				//Fall through - e.g. ring limits reached, the descriptor is still ours
+			}
+		}
+		if (!socket)
+			socket.reset(new zusi::PosixBlockingSocket(client_fd));
+
+		zusi::ServerConnection con(socket.get());
+		con.accept();
+
+		std::cout << "Client: " << con.getClientName() << " Version: " << con.getClientVersion() << std::endl;
+		++g_activeClients;
+
+		//Each client has its own clock, so stepping one does not move the others
+		std::unique_ptr<zusi::Clock> clock = makeClock(settings);
+
+		const zusi::Clock::Duration period(static_cast<int64_t>(1e9 / settings.rate));
+		zusi::Clock::Duration next = clock->now();
+		Frame frame;
+		std::vector<zusi::FsDataValue> changes;
+
+		for (uint64_t sequence = 0; g_running; ++sequence)
+		{
+			const Frame* to_send = &frame;
+			if (profile)
+				to_send = &(*profile)[sequence % profile->size()];
+			else
+				fillSynthetic(frame, settings.vars, sequence, settings.rate);
+
+			bool sent;
+			if (settings.full_state)
+			{
+				changes.clear();
+				for (const std::pair<zusi::FuehrerstandData, float>& item : *to_send)
+					changes.push_back(zusi::FsDataValue(item.first, item.second));
+				sent = con.sendState(changes);
+			}
+			else
+				sent = con.sendData(*to_send);
+
+			if (!sent)
+				break;
+			++g_messages;
+
+			//Absolute deadlines, so oversleeping is caught up instead of lowering the rate
+			next += period;
+			zusi::Clock::Duration now = clock->now();
+			if (next > now)
+				clock->sleepUntil(next);
+			else if (now - next > std::chrono::milliseconds(100))
+				next = now;
+		}
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Client error: " << e.what() << std::endl;
+	}
+
+	--g_activeClients;
+}
+
+//Single producer for the sharded server, every client receives the same updates
+static void produce(zusi::ShardedServer& server, const Settings& settings, const std::vector<Frame>* profile)
+{
+	std::unique_ptr<zusi::Clock> clock = makeClock(settings);
+
+	const zusi::Clock::Duration period(static_cast<int64_t>(1e9 / settings.rate));
+	zusi::Clock::Duration next = clock->now();
+	Frame frame;
+
+	for (uint64_t sequence = 0; g_running; ++sequence)
+	{
+		const Frame* to_send = &frame;
+		if (profile)
+			to_send = &(*profile)[sequence % profile->size()];
+		else
+			fillSynthetic(frame, settings.vars, sequence, settings.rate);
+
+		server.publish(*to_send);
+
+		next += period;
+		zusi::Clock::Duration now = clock->now();
+		if (next > now)
+			clock->sleepUntil(next);
+		else if (now - next > std::chrono::milliseconds(100))
+			next = now;
+	}
+}
+
+static double cpuSeconds()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void report(const zusi::ShardedServer* sharded)
+{
+	auto last_time = std::chrono::steady_clock::now();
+	double last_cpu = cpuSeconds();
+	uint64_t last_messages = sharded ? sharded->messagesSent() : g_messages.load();
+
+	while (g_running)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+		auto now = std::chrono::steady_clock::now();
+		double cpu = cpuSeconds();
+		uint64_t messages = sharded ? sharded->messagesSent() : g_messages.load();
+		size_t clients = sharded ? sharded->clientCount() : g_activeClients.load();
+
+		double elapsed = std::chrono::duration<double>(now - last_time).count();
+		double rate = (messages - last_messages) / elapsed;
+		double cpu_used = cpu - last_cpu;
+
+		std::cout << "clients " << clients
+			<< "  rate " << static_cast<uint64_t>(rate) << " msg/s"
+			<< "  cpu " << static_cast<int>(100.0 * cpu_used / elapsed) << "%";
+		if (messages != last_messages)
+			std::cout << "  " << (1e6 * cpu_used / (messages - last_messages)) << " us/msg";
+		if (sharded)
+			std::cout << "  dropped " << sharded->updatesDropped()
+				<< "  queued " << sharded->queuedBytes() << " bytes"
+				<< "  client drops " << sharded->clientMessagesDropped()
+				<< "  coalesced " << sharded->clientValuesCoalesced()
+				<< "  disconnected " << sharded->clientsDisconnected();
+		std::cout << std::endl;
+
+		last_time = now;
+		last_cpu = cpu;
+		last_messages = messages;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Settings settings;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--port" && has_value)
+			settings.port = atoi(argv[++i]);
+		else if (arg == "--clients" && has_value)
+			settings.clients = atoi(argv[++i]);
+		else if (arg == "--rate" && has_value)
+			settings.rate = atof(argv[++i]);
+		else if (arg == "--vars" && has_value)
+			settings.vars = atoi(argv[++i]);
+		else if (arg == "--profile" && has_value)
+			settings.profile = argv[++i];
+		else if (arg == "--duration" && has_value)
+			settings.duration = atof(argv[++i]);
+		else if (arg == "--uring")
+			settings.uring = true;
+		else if (arg == "--speed" && has_value)
+			settings.speed = atof(argv[++i]);
+		else if (arg == "--step")
+			settings.step = true;
+		else if (arg == "--full-state")
+			settings.full_state = true;
+		else if (arg == "--shards" && has_value)
+			settings.shards = atoi(argv[++i]);
+		else if (arg == "--queue-bytes" && has_value)
+			settings.queue_bytes = strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--queue-policy" && has_value)
+		{
+			std::string name = argv[++i];
+			if (name == "coalesce")
+				settings.queue_policy = zusi::SendQueue::Policy_Coalesce;
+			else if (name == "drop-oldest")
+				settings.queue_policy = zusi::SendQueue::Policy_DropOldest;
+			else if (name == "disconnect")
+				settings.queue_policy = zusi::SendQueue::Policy_Disconnect;
+			else
+			{
+				std::cout << "Unknown queue policy " << name << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	if (settings.rate <= 0.0 || settings.speed <= 0.0)
+	{
+		std::cout << "Rate and speed must be positive" << std::endl;
+		return 1;
+	}
+
+	try {
+		std::unique_ptr<std::vector<Frame>> profile;
+		if (!settings.profile.empty())
+			profile.reset(new std::vector<Frame>(loadProfile(settings.profile)));
+
+		if (settings.shards > 0)
+		{
+			zusi::ShardedServer server(settings.port, settings.shards, 1024, settings.queue_policy, settings.queue_bytes);
+			std::cout << "Serving from " << server.shardCount() << " shards" << std::endl;
+
+			std::thread reporter(report, &server);
+			std::thread producer(produce, std::ref(server), std::cref(settings), profile.get());
+
+			if (settings.duration > 0.0)
+				std::this_thread::sleep_for(std::chrono::duration<double>(settings.duration));
+			else
+				producer.join();
+
+			g_running = false;
+			if (producer.joinable())
+				producer.join();
+			reporter.join();
+			return 0;
+		}
+
+		int listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket < 0)
+			throw std::runtime_error("Socket creation failed.");
+
+		int flag = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+		sockaddr_in bind_to = {};
+		bind_to.sin_family = AF_INET;
+		bind_to.sin_addr.s_addr = INADDR_ANY;
+		bind_to.sin_port = htons(settings.port);
+
+		if (bind(listen_socket, reinterpret_cast<sockaddr*>(&bind_to), sizeof(bind_to)) != 0)
+			throw std::runtime_error("Unable to bind socket!");
+
+		listen(listen_socket, 128);
+
+		std::thread reporter(report, nullptr);
+		std::thread acceptor([&]() {
+			std::vector<std::thread> workers;
+			for (int accepted = 0; settings.clients < 0 || accepted < settings.clients; ++accepted)
+			{
+				int client_socket = accept(listen_socket, NULL, NULL);
+				if (client_socket < 0)
+					break;
+				workers.emplace_back(serveClient, client_socket, std::cref(settings), profile.get());
+			}
+			for (std::thread& worker : workers)
+				worker.join();
+		});
+
+		if (settings.duration > 0.0)
+			std::this_thread::sleep_for(std::chrono::duration<double>(settings.duration));
+		else
+			acceptor.join();
+
+		g_running = false;
+		shutdown(listen_socket, SHUT_RDWR);
+		if (acceptor.joinable())
+			acceptor.join();
+		reporter.join();
+		close(listen_socket);
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Network error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
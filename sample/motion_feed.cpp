@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Low-latency feed for a motion platform (Linux)
+
+  motion_feed [address] [cpu] [priority] - Connect to Zusi and run a 1 kHz actuator loop
+                                           on the latest values, receiving on a busy-polling
+                                           thread pinned to cpu with SCHED_FIFO priority
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "Zusi3TCP.h"
+#include "BusyPollReceiver.h"
+#include "PosixBlockingSocket.h"
+#include "Subscription.h"
+
+typedef zusi::Subscription<zusi::Fs_Geschwindigkeit, zusi::Fs_DruckBremszylinder, zusi::Fs_Motordrehzahl> Platform;
+
+int main(int argc, char** argv)
+{
+	try {
+		zusi::PosixBlockingSocket tcp_socket(argc > 1 ? argv[1] : "127.0.0.1", 1436);
+		zusi::ClientConnection con(&tcp_socket);
+
+		if (!Platform::connect(con, "MotionFeed"))
+		{
+			std::cout << "Error connecting" << std::endl;
+			return 1;
+		}
+
+		zusi::BusyPollReceiver::Options options;
+		options.cpu = argc > 2 ? atoi(argv[2]) : -1;
+		options.fifo_priority = argc > 3 ? atoi(argv[3]) : 0;
+		zusi::BusyPollReceiver receiver(tcp_socket.handle(), options);
+
+		std::cout << "Pinned: " << receiver.pinned() << " Realtime: " << receiver.realtime()
+			<< " Busy polling: " << receiver.busyPolling() << std::endl;
+
+		Platform::Values values;
+		zusi::FrameReader reader;
+		std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point next_report = next_tick;
+
+		while (!receiver.closed())
+		{
+			//Take everything which arrived since the last tick, so the actuators see the latest values
+			while (receiver.poll(reader))
+				Platform::decode(reader, values);
+
+			//Drive the actuators from values here
+
+			next_tick += std::chrono::milliseconds(1);
+			if (next_tick >= next_report)
+			{
+				std::cout << "Messages: " << receiver.messages() << " Stalls: " << receiver.stalls() << " Blocks: " << receiver.blocks()
+					<< " Geschwindigkeit: " << values.get<zusi::Fs_Geschwindigkeit>()
+					<< " DruckBremszylinder: " << values.get<zusi::Fs_DruckBremszylinder>() << std::endl;
+				next_report += std::chrono::seconds(1);
+			}
+			std::this_thread::sleep_until(next_tick);
+		}
+
+		std::cout << "Connection closed" << std::endl;
+		return 0;
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+}
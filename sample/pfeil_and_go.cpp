@@ -22,15 +22,36 @@ SOFTWARE.
 
 #include <iostream>
 #include <chrono>
-#include <thread>
+#include <cstdlib>
+#include <memory>
+#include <string>
 
 #include "Zusi3TCP.h"
+#include "Clock.h"
 #include "DebugSocket.h"
+#include "InputScheduler.h"
 #include "WinsockBlockingSocket.h"
 
+/*
+Options:
+  --speed X  Wait X times shorter between inputs, for use with an accelerated server
+*/
 
 int main(int argc, char** argv)
 {
+	std::unique_ptr<zusi::Clock> clock(new zusi::SystemClock());
+	if (argc == 3 && std::string(argv[1]) == "--speed")
+	{
+		try {
+			clock.reset(new zusi::ScaledClock(atof(argv[2])));
+		}
+		catch (std::runtime_error& e)
+		{
+			std::cout << "Invalid --speed " << argv[2] << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
 	//Create a socket for message printing
 	zusi::DebugSocket debug_socket;
 
@@ -45,21 +66,26 @@ int main(int argc, char** argv)
 
 		//Pfeil
 		con.sendInput(zusi::Tt_Pfeife, zusi::Tk_PfeifeDown, zusi::Ta_Down, 1);
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		clock->sleepFor(std::chrono::milliseconds(500));
 		con.sendInput(zusi::Tt_Pfeife, zusi::Tk_PfeifeUp, zusi::Ta_Up, 0);
 
-		//Fahrschalter 1->5
-		for (int i = 1; i <= 5; ++i)
+		//Fahrschalter 1->5, read every millisecond like a hardware lever
+		//The scheduler sends a position at most every 50ms, and only when it changed
+		zusi::InputScheduler inputs(con, *clock, std::chrono::milliseconds(50));
+		for (int ms = 0; ms <= 4000; ++ms)
 		{
-			con.sendInput(zusi::Tt_Fahrschalter, zusi::Tk_Unbestimmt, zusi::Ta_Absolut, i);
-			std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			inputs.input(zusi::Tt_Fahrschalter, zusi::Tk_Unbestimmt, zusi::Ta_Absolut, static_cast<int16_t>(1 + ms / 1000));
+			inputs.poll();
+			clock->sleepFor(std::chrono::milliseconds(1));
 		}
+		inputs.flush();
+		clock->sleepFor(std::chrono::milliseconds(1000));
 
 		//Fahrschalter 5->10
 		for (int i = 0; i < 5; ++i)
 		{
 			con.sendInput(zusi::Tt_Fahrschalter, zusi::Tk_FahrschalterAuf_Down, zusi::Ta_AufDown, 1);
-			std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+			clock->sleepFor(std::chrono::milliseconds(2000));
 			con.sendInput(zusi::Tt_Fahrschalter, zusi::Tk_FahrschalterAuf_Up, zusi::Ta_AufUp, 0);
 		}
 
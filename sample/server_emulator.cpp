@@ -21,17 +21,45 @@ SOFTWARE.
 */
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <chrono>
-#include <thread>
+#include <cstdlib>
 #include <vector>
 
 #include "Zusi3TCP.h"
+#include "Clock.h"
+#include "PublishScheduler.h"
 #include "WinsockBlockingSocket.h"
 
+/*
+Options:
+  --speed X  Run the scenario X times faster than real time
+  --step     Run the scenario as fast as possible, without waiting
+*/
 
 int main(int argc, char** argv)
 {
+	std::unique_ptr<zusi::Clock> clock(new zusi::SystemClock());
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--speed" && i + 1 < argc)
+		{
+			const char* speed = argv[++i];
+			try {
+				clock.reset(new zusi::ScaledClock(atof(speed)));
+			}
+			catch (std::runtime_error& e)
+			{
+				std::cout << "Invalid --speed " << speed << ": " << e.what() << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--step")
+			clock.reset(new zusi::SteppedClock());
+	}
 
 	try {
 		
@@ -71,18 +99,28 @@ int main(int argc, char** argv)
 
 		std::cout << "Client: " << con.getClientName() << " Version: " << con.getClientVersion() << std::endl;
 
-		std::vector<std::pair<zusi::FuehrerstandData, float>> fake_data;
+		//Speed and current at display rate, the clock once per second, merged into as few messages as possible
+		zusi::PublishScheduler publish(con, *clock, std::chrono::milliseconds(1));
+		publish.setRate(zusi::Fs_Geschwindigkeit, 60.0);
+		publish.setRate(zusi::Fs_Oberstrom, 60.0);
+		publish.setRate(zusi::Fs_UhrzeitSekunde, 1.0);
 
-		//Speed 0 km/h -> 160 km/h Power 0 A ->450 A
-		float speed = 0.0f;
-		for (float speed = 0.0f; speed < 45.0f; speed += 0.5f)
+		//Speed 0 km/h -> 160 km/h Power 0 A ->450 A, simulated in 10ms steps
+		const std::chrono::milliseconds step(10);
+		zusi::Clock::Duration next = clock->now();
+		for (int i = 0; i < 4500; ++i)
 		{
-			fake_data.push_back(std::make_pair(zusi::Fs_Geschwindigkeit, speed));
-			fake_data.push_back(std::make_pair(zusi::Fs_Oberstrom, speed*10.0f));
-			con.sendData(fake_data);
-			fake_data.clear();
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			float seconds = i * 0.01f;
+			publish.post(zusi::Fs_Geschwindigkeit, seconds);
+			publish.post(zusi::Fs_Oberstrom, seconds*10.0f);
+			publish.post(zusi::Fs_UhrzeitSekunde, static_cast<float>(i / 100 % 60));
+			if (!publish.poll())
+				break;
+
+			next += step;
+			clock->sleepUntil(next);
 		}
+		publish.flush();
 
 		// Shutdown our socket
 		shutdown(listen_socket, SD_SEND);
@@ -0,0 +1,504 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Zusi multiplexing proxy (Linux)
+
+Holds a single connection to Zusi and serves any number of local clients.
+The upstream subscription is the union of everything the clients request;
+when a client asks for something new the upstream connection is renewed.
+The latest value of each variable is kept, so a new client immediately
+receives a complete snapshot instead of waiting for Zusi to send changes.
+Each client only receives the variables it requested. INPUT, CONTROL and
+GRAPHIC commands from the clients are forwarded to Zusi.
+
+Data for each client is sent from a bounded queue by its own thread, so a
+client which stops reading does not hold up the others.
+
+Usage: zusi_proxy [options]
+  --upstream ADDRESS   Address of Zusi (default 127.0.0.1)
+  --upstream-port N    Port of Zusi (default 1436)
+  --port N             Port to listen on for clients (default 1437)
+  --queue-bytes N      Send queue limit per client (default 262144)
+  --queue-policy P     What to do when a client's queue is full: coalesce
+                       (keep only the latest values, default), drop-oldest
+                       or disconnect
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Zusi3TCP.h"
+#include "PosixBlockingSocket.h"
+#include "QueuedSocket.h"
+
+//! A client of the proxy
+struct Downstream
+{
+	Downstream(int fd, size_t queue_bytes, zusi::SendQueue::Policy policy) : socket(fd), queued(&socket, queue_bytes, policy), con(&queued), alive(true)
+	{
+	}
+
+	zusi::PosixBlockingSocket socket;
+	zusi::QueuedSocket queued;
+	zusi::ServerConnection con;
+
+	//! False after a failed send, guarded by Proxy::m_mutex
+	bool alive;
+};
+
+class Proxy
+{
+public:
+	Proxy(const std::string& address, int port, size_t queue_bytes, zusi::SendQueue::Policy policy) : m_address(address), m_port(port),
+		m_queueBytes(queue_bytes), m_policy(policy), m_bedienung(false), m_resubscribe(false)
+	{
+	}
+
+	//! Maintain the upstream connection and distribute received data. Does not return.
+	void runUpstream()
+	{
+		while (true)
+		{
+			std::vector<zusi::FuehrerstandData> fs_data;
+			std::vector<zusi::ProgData> prog_data;
+			bool bedienung;
+			{
+				//Nothing to subscribe to until the first client has connected
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_changed.wait(lock, [this]() { return !m_fs_data.empty() || !m_prog_data.empty() || m_bedienung; });
+
+				fs_data.assign(m_fs_data.begin(), m_fs_data.end());
+				prog_data.assign(m_prog_data.begin(), m_prog_data.end());
+				bedienung = m_bedienung;
+				m_resubscribe = false;
+			}
+
+			std::unique_ptr<zusi::PosixBlockingSocket> socket;
+			std::unique_ptr<zusi::ClientConnection> con;
+			try
+			{
+				socket.reset(new zusi::PosixBlockingSocket(m_address.c_str(), m_port));
+				con.reset(new zusi::ClientConnection(socket.get()));
+				con->connect("Zusi3TCP Proxy", fs_data, prog_data, bedienung, true);
+			}
+			catch (std::runtime_error& e)
+			{
+				std::cout << "Upstream: " << e.what() << std::endl;
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+				continue;
+			}
+
+			std::cout << "Upstream: connected to Zusi " << con->getZusiVersion() << " with " << fs_data.size()
+				<< " Fuehrerstand variables" << std::endl;
+
+			{
+				std::lock_guard<std::mutex> lock(m_upstreamMutex);
+				m_upstreamSocket = socket.get();
+				m_upstream = con.get();
+			}
+
+			//A client may have extended the subscription while connect() was running
+			bool resubscribe;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				resubscribe = m_resubscribe;
+			}
+
+			while (!resubscribe)
+			{
+				zusi::Node msg;
+				if (!con->receiveMessage(msg))
+					break;
+				distribute(msg);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_upstreamMutex);
+				m_upstreamSocket = nullptr;
+				m_upstream = nullptr;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				resubscribe = m_resubscribe;
+			}
+
+			if (resubscribe)
+			{
+				std::cout << "Upstream: renewing subscription" << std::endl;
+			}
+			else
+			{
+				std::cout << "Upstream: connection lost" << std::endl;
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		}
+	}
+
+	//! Handshake with a client, then forward its commands upstream until it disconnects
+	void serveClient(int fd)
+	{
+		std::shared_ptr<Downstream> client(new Downstream(fd, m_queueBytes, m_policy));
+
+		try
+		{
+			client->con.accept();
+		}
+		catch (std::runtime_error& e)
+		{
+			std::cout << "Client handshake failed: " << e.what() << std::endl;
+			return;
+		}
+
+		std::cout << "Client: " << client->con.getClientName() << " Version: " << client->con.getClientVersion() << std::endl;
+		addClient(client);
+
+		while (true)
+		{
+			zusi::Node msg;
+			if (!client->con.receiveMessage(msg))
+				break;
+
+			if (msg.getId() == zusi::MsgType_Fahrpult)
+				forwardUpstream(msg);
+		}
+
+		removeClient(client);
+		std::cout << "Client disconnected: " << client->con.getClientName() << " Dropped messages: " << client->queued.droppedMessages()
+			<< " Coalesced values: " << client->queued.coalescedValues() << std::endl;
+
+		//Unblocks the writer thread if it is stuck sending to a client which stopped reading
+		shutdown(client->socket.handle(), SHUT_RDWR);
+	}
+
+private:
+
+	void addClient(const std::shared_ptr<Downstream>& client)
+	{
+		const zusi::ServerConnection& con = client->con;
+		bool extended = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			for (zusi::FuehrerstandData id : con.getFuehrerstandData())
+				extended |= m_fs_data.insert(id).second;
+			for (zusi::ProgData id : con.getProgData())
+				extended |= m_prog_data.insert(id).second;
+			if (con.getBedienung() && !m_bedienung)
+			{
+				m_bedienung = true;
+				extended = true;
+			}
+
+			if (extended)
+				m_resubscribe = true;
+
+			//Registered and sent under the same lock as distribute(), so the client neither misses nor repeats an update
+			m_clients.push_back(client);
+			sendSnapshot(*client);
+		}
+
+		if (!extended)
+			return;
+
+		m_changed.notify_all();
+
+		//Zusi only accepts NEEDED_DATA during the handshake, so the upstream connection is renewed
+		std::lock_guard<std::mutex> lock(m_upstreamMutex);
+		if (m_upstreamSocket)
+			shutdown(m_upstreamSocket->handle(), SHUT_RDWR);
+	}
+
+	void removeClient(const std::shared_ptr<Downstream>& client)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it = m_clients.begin(); it != m_clients.end(); ++it)
+		{
+			if (*it == client)
+			{
+				m_clients.erase(it);
+				break;
+			}
+		}
+	}
+
+	void forwardUpstream(zusi::Node& msg)
+	{
+		std::lock_guard<std::mutex> lock(m_upstreamMutex);
+		if (m_upstream)
+			m_upstream->sendMessage(msg);
+	}
+
+	//! Update the cache and send each client the part of the message it requested
+	void distribute(const zusi::Node& msg)
+	{
+		if (msg.getId() != zusi::MsgType_Fahrpult)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (const zusi::Node* cmd : msg.nodes)
+			updateCache(*cmd);
+
+		for (const std::shared_ptr<Downstream>& client : m_clients)
+		{
+			if (!client->alive)
+				continue;
+
+			zusi::Node out(zusi::MsgType_Fahrpult);
+			for (const zusi::Node* cmd : msg.nodes)
+				appendFiltered(out, *cmd, client->con);
+
+			if (!out.nodes.empty())
+				send(*client, out);
+		}
+	}
+
+	void updateCache(const zusi::Node& cmd)
+	{
+		if (cmd.getId() == zusi::Cmd_DATA_FTD)
+		{
+			for (const zusi::Attribute* att : cmd.attributes)
+				m_ftdAttributes[att->getId()].reset(new zusi::Attribute(*att));
+			for (const zusi::Node* node : cmd.nodes)
+				m_ftdNodes[node->getId()].reset(new zusi::Node(*node));
+		}
+		else if (cmd.getId() == zusi::Cmd_DATA_PROG)
+		{
+			for (const zusi::Attribute* att : cmd.attributes)
+				m_progAttributes[att->getId()].reset(new zusi::Attribute(*att));
+		}
+	}
+
+	static void appendFiltered(zusi::Node& out, const zusi::Node& cmd, const zusi::ServerConnection& con)
+	{
+		zusi::Node* filtered = nullptr;
+
+		if (cmd.getId() == zusi::Cmd_DATA_FTD)
+		{
+			filtered = new zusi::Node(cmd.getId());
+			for (const zusi::Attribute* att : cmd.attributes)
+				if (con.getFuehrerstandData().count(static_cast<zusi::FuehrerstandData>(att->getId())))
+					filtered->attributes.push_back(new zusi::Attribute(*att));
+			for (const zusi::Node* node : cmd.nodes)
+				if (con.getFuehrerstandData().count(static_cast<zusi::FuehrerstandData>(node->getId())))
+					filtered->nodes.push_back(new zusi::Node(*node));
+		}
+		else if (cmd.getId() == zusi::Cmd_DATA_PROG)
+		{
+			filtered = new zusi::Node(cmd.getId());
+			for (const zusi::Attribute* att : cmd.attributes)
+				if (con.getProgData().count(static_cast<zusi::ProgData>(att->getId())))
+					filtered->attributes.push_back(new zusi::Attribute(*att));
+		}
+		else if (cmd.getId() == zusi::Cmd_DATA_OPERATION && con.getBedienung())
+		{
+			filtered = new zusi::Node(cmd);
+		}
+
+		if (!filtered)
+			return;
+
+		if (filtered->attributes.empty() && filtered->nodes.empty())
+			delete filtered;
+		else
+			out.nodes.push_back(filtered);
+	}
+
+	//! Send the cached values requested by a client. Called with m_mutex held.
+	void sendSnapshot(Downstream& client)
+	{
+		zusi::Node out(zusi::MsgType_Fahrpult);
+
+		zusi::Node* ftd = new zusi::Node(zusi::Cmd_DATA_FTD);
+		out.nodes.push_back(ftd);
+		for (zusi::FuehrerstandData id : client.con.getFuehrerstandData())
+		{
+			auto att = m_ftdAttributes.find(id);
+			if (att != m_ftdAttributes.end())
+				ftd->attributes.push_back(new zusi::Attribute(*att->second));
+
+			auto node = m_ftdNodes.find(id);
+			if (node != m_ftdNodes.end())
+				ftd->nodes.push_back(new zusi::Node(*node->second));
+		}
+
+		zusi::Node* prog = new zusi::Node(zusi::Cmd_DATA_PROG);
+		out.nodes.push_back(prog);
+		for (zusi::ProgData id : client.con.getProgData())
+		{
+			auto att = m_progAttributes.find(id);
+			if (att != m_progAttributes.end())
+				prog->attributes.push_back(new zusi::Attribute(*att->second));
+		}
+
+		//Only send commands which have content
+		for (auto it = out.nodes.begin(); it != out.nodes.end();)
+		{
+			if ((*it)->attributes.empty() && (*it)->nodes.empty())
+			{
+				delete *it;
+				it = out.nodes.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		if (!out.nodes.empty())
+			send(client, out);
+	}
+
+	//! Queue a message for a client, and disconnect it if that fails. Called with m_mutex held.
+	static void send(Downstream& client, zusi::Node& msg)
+	{
+		if (client.con.sendMessage(msg))
+			return;
+
+		//The client's thread notices the shutdown and removes it
+		client.alive = false;
+		shutdown(client.socket.handle(), SHUT_RDWR);
+	}
+
+	const std::string m_address;
+	const int m_port;
+	const size_t m_queueBytes;
+	const zusi::SendQueue::Policy m_policy;
+
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+
+	//Union of all client subscriptions
+	std::set<zusi::FuehrerstandData> m_fs_data;
+	std::set<zusi::ProgData> m_prog_data;
+	bool m_bedienung;
+	bool m_resubscribe;
+
+	std::vector<std::shared_ptr<Downstream>> m_clients;
+
+	//Latest value of each variable
+	std::map<uint16_t, std::unique_ptr<zusi::Attribute>> m_ftdAttributes;
+	std::map<uint16_t, std::unique_ptr<zusi::Node>> m_ftdNodes;
+	std::map<uint16_t, std::unique_ptr<zusi::Attribute>> m_progAttributes;
+
+	//Used by client threads to forward commands, guarded by m_upstreamMutex
+	std::mutex m_upstreamMutex;
+	zusi::PosixBlockingSocket* m_upstreamSocket = nullptr;
+	zusi::ClientConnection* m_upstream = nullptr;
+};
+
+int main(int argc, char** argv)
+{
+	std::string upstream_address = "127.0.0.1";
+	int upstream_port = 1436;
+	int port = 1437;
+	size_t queue_bytes = 256 * 1024;
+	zusi::SendQueue::Policy policy = zusi::SendQueue::Policy_Coalesce;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--upstream" && has_value)
+			upstream_address = argv[++i];
+		else if (arg == "--upstream-port" && has_value)
+			upstream_port = atoi(argv[++i]);
+		else if (arg == "--port" && has_value)
+			port = atoi(argv[++i]);
+		else if (arg == "--queue-bytes" && has_value)
+			queue_bytes = strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--queue-policy" && has_value)
+		{
+			std::string name = argv[++i];
+			if (name == "coalesce")
+				policy = zusi::SendQueue::Policy_Coalesce;
+			else if (name == "drop-oldest")
+				policy = zusi::SendQueue::Policy_DropOldest;
+			else if (name == "disconnect")
+				policy = zusi::SendQueue::Policy_Disconnect;
+			else
+			{
+				std::cout << "Unknown queue policy " << name << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cout << "Unknown option " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	try {
+		int listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket < 0)
+			throw std::runtime_error("Socket creation failed.");
+
+		int flag = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+		sockaddr_in bind_to = {};
+		bind_to.sin_family = AF_INET;
+		bind_to.sin_addr.s_addr = INADDR_ANY;
+		bind_to.sin_port = htons(port);
+
+		if (bind(listen_socket, reinterpret_cast<sockaddr*>(&bind_to), sizeof(bind_to)) != 0)
+			throw std::runtime_error("Unable to bind socket!");
+
+		listen(listen_socket, 128);
+
+		Proxy proxy(upstream_address, upstream_port, queue_bytes, policy);
+		std::thread upstream(&Proxy::runUpstream, &proxy);
+		upstream.detach();
+
+		std::cout << "Proxy for " << upstream_address << ":" << upstream_port << " listening on port " << port << std::endl;
+
+		//Runs for the lifetime of the process, the detached threads use the proxy
+		while (true)
+		{
+			int client_socket = accept(listen_socket, NULL, NULL);
+			if (client_socket >= 0)
+				std::thread(&Proxy::serveClient, &proxy, client_socket).detach();
+		}
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Network error: " << e.what() << std::endl;
+		return 1;
+	}
+}
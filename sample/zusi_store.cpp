@@ -0,0 +1,165 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Zusi value recorder and column store (Linux)
+
+Records the DATA_FTD messages sent by Zusi into a capture file, converts
+captures into a compressed column store and answers range queries from it.
+Queries only decompress the blocks at the edges of the requested time range.
+
+Usage:
+  zusi_store record ADDRESS CAPTURE ID...
+      Subscribe to the given Fuehrerstand IDs and record until interrupted
+  zusi_store convert CAPTURE STORE [THREADS]
+      Build a column store, decoding the capture on THREADS threads
+      (default all cores)
+  zusi_store info STORE
+      List the stored variables
+  zusi_store query STORE ID T1 T2
+      Count, minimum, maximum and mean of a variable between T1 and T2,
+      given in seconds from the start of the store
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Capture.h"
+#include "ColumnStore.h"
+#include "PosixBlockingSocket.h"
+
+static uint64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t toNs(double seconds)
+{
+	return static_cast<uint64_t>(seconds * 1e9);
+}
+
+static int record(const std::string& address, const std::string& filename, const std::vector<zusi::FuehrerstandData>& fs_data)
+{
+	zusi::PosixBlockingSocket socket(address.c_str(), 1436);
+	zusi::ClientConnection con(&socket);
+	con.connect("Zusi3TCP Recorder", fs_data, std::vector<zusi::ProgData>(), false);
+	std::cout << "Connected to " << con.getZusiVersion() << ", recording to " << filename << std::endl;
+
+	zusi::CaptureWriter writer(filename);
+	uint64_t count = 0;
+
+	while (true)
+	{
+		zusi::Node msg;
+		if (!con.receiveMessage(msg))
+			break;
+		writer.write(nowNs(), msg);
+
+		if (++count % 10000 == 0)
+			std::cout << count << " messages" << std::endl;
+	}
+
+	std::cout << "Connection closed after " << count << " messages" << std::endl;
+	return 0;
+}
+
+static int convert(const std::string& capture_file, const std::string& store_file, unsigned threads)
+{
+	auto start = std::chrono::steady_clock::now();
+	zusi::ColumnStore::ConversionStatistics stats = zusi::ColumnStore::convert(capture_file, store_file, threads);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << stats.records << " messages, " << stats.values << " values in " << stats.columns << " columns" << std::endl;
+	std::cout << stats.chunks << " chunks on " << stats.threads << " threads in " << seconds << " s" << std::endl;
+	return 0;
+}
+
+static int info(const std::string& filename)
+{
+	zusi::ColumnStore store(filename);
+	double duration = (store.lastTime() - store.firstTime()) / 1e9;
+	std::cout << "Duration " << duration << " s" << std::endl;
+
+	for (uint16_t id : store.columns())
+	{
+		zusi::ColumnStore::Summary summary = store.summarize(id, store.firstTime(), store.lastTime());
+		std::cout << "ID " << id << ": " << summary.count << " values, " << summary.min << " to " << summary.max << std::endl;
+	}
+	return 0;
+}
+
+static int query(const std::string& filename, uint16_t id, double t1, double t2)
+{
+	zusi::ColumnStore store(filename);
+
+	auto start = std::chrono::steady_clock::now();
+	zusi::ColumnStore::Summary summary = store.summarize(id, store.firstTime() + toNs(t1), store.firstTime() + toNs(t2));
+	double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	if (summary.count == 0)
+	{
+		std::cout << "No values" << std::endl;
+		return 0;
+	}
+
+	std::cout << "Count " << summary.count << std::endl;
+	std::cout << "Min " << summary.min << std::endl;
+	std::cout << "Max " << summary.max << std::endl;
+	std::cout << "Mean " << summary.sum / summary.count << std::endl;
+	std::cout << summary.blocks_decoded << " blocks decoded in " << micros << " us" << std::endl;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	std::string mode = argc > 1 ? argv[1] : "";
+
+	try {
+		if (mode == "record" && argc > 4)
+		{
+			std::vector<zusi::FuehrerstandData> fs_data;
+			for (int i = 4; i < argc; ++i)
+				fs_data.push_back(static_cast<zusi::FuehrerstandData>(atoi(argv[i])));
+			return record(argv[2], argv[3], fs_data);
+		}
+		else if (mode == "convert" && argc > 3)
+			return convert(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0);
+		else if (mode == "info" && argc > 2)
+			return info(argv[2]);
+		else if (mode == "query" && argc > 5)
+			return query(argv[2], static_cast<uint16_t>(atoi(argv[3])), atof(argv[4]), atof(argv[5]));
+	}
+	catch (std::runtime_error& e)
+	{
+		std::cout << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cout << "Usage: zusi_store record ADDRESS CAPTURE ID..." << std::endl;
+	std::cout << "       zusi_store convert CAPTURE STORE [THREADS]" << std::endl;
+	std::cout << "       zusi_store info STORE" << std::endl;
+	std::cout << "       zusi_store query STORE ID T1 T2" << std::endl;
+	return 1;
+}
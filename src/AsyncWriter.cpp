@@ -0,0 +1,135 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "AsyncWriter.h"
+
+#include <cstring>
+
+namespace zusi
+{
+
+	AsyncWriter::AsyncWriter(FILE* file, size_t buffer_bytes, size_t max_buffers) : m_file(file), m_bufferBytes(buffer_bytes),
+		m_maxBuffers(max_buffers > 0 ? max_buffers : 1), m_current(buffer_bytes), m_used(0), m_waits(0),
+		m_writing(false), m_stopping(false), m_failed(false)
+	{
+		m_writer = std::thread(&AsyncWriter::writerLoop, this);
+	}
+
+	AsyncWriter::~AsyncWriter()
+	{
+		finish();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_ready.notify_one();
+		m_writer.join();
+	}
+
+	char* AsyncWriter::prepare(size_t bytes)
+	{
+		if (m_current.size() - m_used < bytes)
+		{
+			flush();
+			if (m_current.size() < bytes)
+				m_current.resize(bytes);
+		}
+
+		return m_current.data() + m_used;
+	}
+
+	void AsyncWriter::append(const void* src, size_t bytes)
+	{
+		memcpy(prepare(bytes), src, bytes);
+		commit(bytes);
+	}
+
+	void AsyncWriter::flush()
+	{
+		if (m_used == 0)
+			return;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_full.size() >= m_maxBuffers)
+			{
+				++m_waits;
+				m_written.wait(lock, [this] { return m_full.size() < m_maxBuffers; });
+			}
+
+			Buffer full;
+			full.data.swap(m_current);
+			full.bytes = m_used;
+			m_full.push_back(std::move(full));
+
+			//Reuse a written buffer if there is one
+			if (!m_free.empty())
+			{
+				m_current.swap(m_free.back());
+				m_free.pop_back();
+			}
+		}
+		m_ready.notify_one();
+
+		if (m_current.size() < m_bufferBytes)
+			m_current.resize(m_bufferBytes);
+		m_used = 0;
+	}
+
+	bool AsyncWriter::finish()
+	{
+		flush();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_written.wait(lock, [this] { return m_full.empty() && !m_writing; });
+		if (fflush(m_file) != 0)
+			m_failed = true;
+		return !m_failed;
+	}
+
+	void AsyncWriter::writerLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_ready.wait(lock, [this] { return !m_full.empty() || m_stopping; });
+			if (m_full.empty())
+				return;
+
+			Buffer buffer = std::move(m_full.front());
+			m_full.pop_front();
+			m_writing = true;
+
+			lock.unlock();
+			bool written = fwrite(buffer.data.data(), 1, buffer.bytes, m_file) == buffer.bytes;
+			lock.lock();
+
+			if (!written)
+				m_failed = true;
+			m_writing = false;
+			m_free.push_back(std::move(buffer.data));
+			m_written.notify_all();
+		}
+	}
+
+}
@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Buffered output to a file, written by a separate thread
+	*
+	* Output is collected in large buffers; full buffers are handed to a writer
+	* thread, so the thread producing the output does not wait for the disk or a
+	* slow terminal. It only waits if the given number of buffers is already waiting
+	* to be written, which is counted in waits().
+	*
+	* Only one thread at a time may write to the AsyncWriter.
+	*/
+	class AsyncWriter
+	{
+	public:
+		/**
+		* @brief Start the writer thread
+		* @param file File to write to, e.g. stdout - class does not take ownership of it
+		* @param buffer_bytes Size of each buffer
+		* @param max_buffers Number of full buffers which may wait to be written
+		*/
+		AsyncWriter(FILE* file, size_t buffer_bytes = 64 * 1024, size_t max_buffers = 64);
+
+		//! Write remaining output and stop the writer thread. The file is not closed.
+		~AsyncWriter();
+
+		/**
+		* @brief Reserve space for output
+		* @return Pointer to write up to bytes to. Call commit() afterwards with the number of bytes actually written.
+		*/
+		char* prepare(size_t bytes);
+
+		//! Mark bytes written to the pointer returned by prepare() as output
+		void commit(size_t bytes) { m_used += bytes; }
+
+		//! Copy bytes to the output
+		void append(const void* src, size_t bytes);
+
+		//! Hand the output collected so far to the writer thread, without waiting for it to be written
+		void flush();
+
+		/**
+		* @brief Wait until all output has been written and flushed to the file
+		* @return False if a write has failed
+		*/
+		bool finish();
+
+		//! Number of bytes collected but not handed to the writer thread yet
+		size_t pendingBytes() const { return m_used; }
+
+		//! Number of times output had to wait for the writer thread
+		uint64_t waits() const { return m_waits; }
+
+	private:
+		struct Buffer
+		{
+			std::vector<char> data;
+			size_t bytes;
+		};
+
+		AsyncWriter(const AsyncWriter& other);
+
+		void writerLoop();
+
+		FILE* m_file;
+		size_t m_bufferBytes;
+		size_t m_maxBuffers;
+
+		//! Buffer being filled, producer only
+		std::vector<char> m_current;
+		size_t m_used;
+		uint64_t m_waits;
+
+		std::mutex m_mutex;
+		std::condition_variable m_ready;
+		std::condition_variable m_written;
+		std::deque<Buffer> m_full;
+		std::vector<std::vector<char>> m_free;
+		bool m_writing;
+		bool m_stopping;
+		bool m_failed;
+
+		std::thread m_writer;
+	};
+
+}
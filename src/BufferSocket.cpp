@@ -0,0 +1,60 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "BufferSocket.h"
+
+#include <cstring>
+
+namespace zusi
+{
+
+	BufferSocket::BufferSocket() : m_input(nullptr), m_inputBytes(0), m_readPos(0)
+	{
+	}
+
+	BufferSocket::BufferSocket(const void* src, size_t bytes) : m_input(static_cast<const char*>(src)), m_inputBytes(bytes), m_readPos(0)
+	{
+	}
+
+	BufferSocket::~BufferSocket()
+	{
+	}
+
+	int BufferSocket::ReadBytes(void* dest, int bytes)
+	{
+		size_t available = m_inputBytes - m_readPos;
+		size_t count = static_cast<size_t>(bytes) < available ? static_cast<size_t>(bytes) : available;
+
+		memcpy(dest, m_input + m_readPos, count);
+		m_readPos += count;
+
+		return static_cast<int>(count);
+	}
+
+	int BufferSocket::WriteBytes(const void* src, int bytes)
+	{
+		const char* src_chars = static_cast<const char*>(src);
+		m_output.insert(m_output.end(), src_chars, src_chars + bytes);
+		return bytes;
+	}
+
+}
@@ -0,0 +1,75 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+namespace zusi
+{
+
+	/**
+	* @brief Socket which reads from and writes to memory
+	*
+	* ReadBytes() consumes a fixed input buffer supplied by the caller, which is not copied.
+	* WriteBytes() appends to an internal output buffer.
+	*/
+	class BufferSocket :
+		public zusi::Socket
+	{
+	public:
+		//! Construct a socket with no input data
+		BufferSocket();
+
+		/**
+		* @brief Construct a socket which reads from src
+		* @param src Input data - must remain valid while the socket is read from
+		* @param bytes Size of input data
+		*/
+		BufferSocket(const void* src, size_t bytes);
+
+		virtual ~BufferSocket();
+
+		virtual int ReadBytes(void* dest, int bytes);
+		virtual int WriteBytes(const void* src, int bytes);
+		virtual bool DataToRead() { return m_readPos < m_inputBytes; };
+
+		//! Remaining input, or -1 once all input has been read
+		virtual int BytesAvailable() { return m_readPos < m_inputBytes ? static_cast<int>(m_inputBytes - m_readPos) : -1; }
+
+		//! Returns immediately, the input is always complete
+		virtual bool WaitReadable(std::chrono::microseconds) { return true; }
+
+		//! Data written to the socket so far
+		const std::vector<char>& output() const { return m_output; }
+
+		//! Discard written data
+		void clearOutput() { m_output.clear(); }
+
+	private:
+		const char* m_input;
+		size_t m_inputBytes;
+		size_t m_readPos;
+
+		std::vector<char> m_output;
+	};
+
+}
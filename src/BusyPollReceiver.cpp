@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "BusyPollReceiver.h"
+#include "FrameBuffer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+namespace zusi
+{
+	//! Bytes requested from the socket per read
+	static const size_t RECV_BYTES = 64 * 1024;
+
+	//! Longest time the receive thread blocks before checking whether it should stop
+	static const int BLOCK_TIMEOUT_MS = 20;
+
+	//! Spins waiting for the other thread before yielding the CPU to it
+	static const unsigned SPINS_BEFORE_YIELD = 1000;
+
+	//! Tell the CPU we are spinning
+	static inline void cpuRelax()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	//! Spin for a while, then let other threads on the same CPU run
+	static inline void backoff(unsigned& spins)
+	{
+		if (++spins < SPINS_BEFORE_YIELD)
+			cpuRelax();
+		else
+			std::this_thread::yield();
+	}
+
+	BusyPollReceiver::BusyPollReceiver(int socket, const Options& options) : m_socket(socket), m_spinUs(options.spin_us),
+		m_slots(nullptr), m_slotCount(options.slots > 2 ? options.slots : 2), m_write(0), m_read(0), m_holding(false),
+		m_pinned(false), m_realtime(false), m_busyPolling(false),
+		m_running(true), m_closed(false), m_messages(0), m_stalls(0), m_blocks(0)
+	{
+		//new does not guarantee the alignment of over-aligned types before C++17
+		void* memory;
+		if (posix_memalign(&memory, CACHE_LINE, m_slotCount * sizeof(Slot)) != 0)
+			throw std::bad_alloc();
+		m_slots = static_cast<Slot*>(memory);
+		for (size_t i = 0; i < m_slotCount; ++i)
+			new (&m_slots[i]) Slot();
+
+		if (options.busy_poll_us > 0)
+		{
+			int busy_poll = static_cast<int>(options.busy_poll_us);
+			m_busyPolling = setsockopt(m_socket, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) == 0;
+		}
+
+		m_thread = std::thread(&BusyPollReceiver::run, this);
+
+		if (options.cpu >= 0)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(options.cpu, &cpus);
+			m_pinned = pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus) == 0;
+		}
+
+		if (options.fifo_priority > 0)
+		{
+			sched_param param;
+			memset(&param, 0, sizeof(param));
+			param.sched_priority = options.fifo_priority;
+			m_realtime = pthread_setschedparam(m_thread.native_handle(), SCHED_FIFO, &param) == 0;
+		}
+	}
+
+	BusyPollReceiver::~BusyPollReceiver()
+	{
+		m_running.store(false);
+		m_thread.join();
+
+		for (size_t i = 0; i < m_slotCount; ++i)
+			m_slots[i].~Slot();
+		free(m_slots);
+	}
+
+	bool BusyPollReceiver::poll(FrameReader& reader)
+	{
+		if (m_holding)
+		{
+			m_slots[m_read].full.store(false, std::memory_order_release);
+			m_read = (m_read + 1) % m_slotCount;
+			m_holding = false;
+		}
+
+		Slot& slot = m_slots[m_read];
+		if (!slot.full.load(std::memory_order_acquire))
+			return false;
+
+		reader = FrameReader(slot.frame.data(), slot.bytes);
+		m_holding = true;
+		return true;
+	}
+
+	bool BusyPollReceiver::receive(FrameReader& reader)
+	{
+		unsigned spins = 0;
+		while (!poll(reader))
+		{
+			if (closed())
+				return false;
+			backoff(spins);
+		}
+		return true;
+	}
+
+	bool BusyPollReceiver::closed()
+	{
+		//Check the slot after the flag, so that a message published just before closing is not missed
+		if (!m_closed.load(std::memory_order_acquire))
+			return false;
+
+		if (m_holding)
+			return m_slots[(m_read + 1) % m_slotCount].full.load(std::memory_order_acquire) == false;
+
+		return !m_slots[m_read].full.load(std::memory_order_acquire);
+	}
+
+	void BusyPollReceiver::run()
+	{
+		FrameBuffer buffer;
+		std::chrono::steady_clock::time_point last_data = std::chrono::steady_clock::now();
+		const std::chrono::microseconds spin(m_spinUs);
+
+		while (m_running.load(std::memory_order_relaxed))
+		{
+			ssize_t received = recv(m_socket, buffer.prepare(RECV_BYTES), RECV_BYTES, MSG_DONTWAIT);
+			if (received > 0)
+			{
+				buffer.commit(static_cast<size_t>(received));
+
+				try
+				{
+					size_t length;
+					while ((length = buffer.frameLength()) > 0)
+					{
+						if (!publish(buffer.data(), length))
+							break;
+						buffer.consume(length);
+					}
+				}
+				catch (const std::runtime_error&)
+				{
+					//Invalid data - the stream cannot be resynchronised
+					break;
+				}
+
+				last_data = std::chrono::steady_clock::now();
+				continue;
+			}
+
+			if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+				break;
+
+			if (m_spinUs < 0 || std::chrono::steady_clock::now() - last_data < spin)
+			{
+				cpuRelax();
+				continue;
+			}
+
+			//Nothing for a while - sleep until data arrives, then spin again
+			m_blocks.fetch_add(1, std::memory_order_relaxed);
+			pollfd wait;
+			wait.fd = m_socket;
+			wait.events = POLLIN;
+			wait.revents = 0;
+			if (::poll(&wait, 1, BLOCK_TIMEOUT_MS) > 0)
+				last_data = std::chrono::steady_clock::now();
+		}
+
+		m_closed.store(true, std::memory_order_release);
+	}
+
+	bool BusyPollReceiver::publish(const char* frame, size_t bytes)
+	{
+		Slot& slot = m_slots[m_write];
+		if (slot.full.load(std::memory_order_acquire))
+		{
+			m_stalls.fetch_add(1, std::memory_order_relaxed);
+			unsigned spins = 0;
+			while (slot.full.load(std::memory_order_acquire))
+			{
+				if (!m_running.load(std::memory_order_relaxed))
+					return false;
+				backoff(spins);
+			}
+		}
+
+		if (slot.frame.size() < bytes)
+			slot.frame.resize(bytes);
+		memcpy(slot.frame.data(), frame, bytes);
+		slot.bytes = bytes;
+
+		slot.full.store(true, std::memory_order_release);
+		m_write = (m_write + 1) % m_slotCount;
+		m_messages.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+}
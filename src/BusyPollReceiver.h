@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "FrameReader.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Receives messages on a dedicated thread which busy-polls the socket (Linux)
+	*
+	* For consumers where the time between a message arriving and it being seen
+	* matters more than CPU use. The receive thread reads the socket without blocking,
+	* optionally with the kernel's SO_BUSY_POLL, pinned to a CPU and with real-time
+	* priority. It only blocks after finding no data for a configurable time.
+	*
+	* Complete messages are copied into a ring of cache-line-aligned slots, which the
+	* consumer takes with poll() or receive(). If all slots are full, the receive thread
+	* waits for the consumer; messages are never dropped.
+	*
+	* Start the receiver after ClientConnection::connect(), and do not receive through
+	* the connection while it runs. Sending through the connection is still possible.
+	*/
+	class BusyPollReceiver
+	{
+	public:
+
+		//! Tuning options
+		struct Options
+		{
+			Options() : cpu(-1), fifo_priority(0), busy_poll_us(50), spin_us(1000), slots(8)
+			{
+			}
+
+			//! CPU to run the receive thread on, -1 to leave this to the scheduler
+			int cpu;
+			//! SCHED_FIFO priority of the receive thread (1 to 99), 0 for normal scheduling
+			int fifo_priority;
+			//! SO_BUSY_POLL time of the socket, 0 to leave it unchanged
+			unsigned busy_poll_us;
+			//! Time without data after which the thread blocks until data arrives, -1 to never block
+			int spin_us;
+			//! Number of messages which can wait for the consumer, at least 2
+			unsigned slots;
+		};
+
+		/**
+		* @brief Start the receive thread
+		*
+		* Pinning and real-time priority need the right privileges (e.g. CAP_SYS_NICE);
+		* if they are refused the receiver runs without them, see pinned() and realtime().
+		* @param socket File descriptor of a connected socket, e.g. PosixBlockingSocket::handle() - class does not take ownership of it
+		* @param options Tuning options
+		*/
+		BusyPollReceiver(int socket, const Options& options = Options());
+
+		//! Stop the receive thread
+		~BusyPollReceiver();
+
+		/**
+		* @brief Take the next message if one has arrived, without waiting
+		*
+		* The message stays valid until the next call to poll() or receive(), which
+		* releases its slot. Consumer thread only.
+		* @return False if no message is waiting
+		*/
+		bool poll(FrameReader& reader);
+
+		/**
+		* @brief Wait for the next message, spinning and then yielding the CPU
+		* @return False if the connection was closed and all messages have been taken
+		*/
+		bool receive(FrameReader& reader);
+
+		//! True if the connection was closed or sent invalid data, and all messages have been taken
+		bool closed();
+
+		//! True if the receive thread was pinned to Options::cpu
+		bool pinned() const { return m_pinned; }
+
+		//! True if the receive thread runs with SCHED_FIFO
+		bool realtime() const { return m_realtime; }
+
+		//! True if SO_BUSY_POLL was set on the socket
+		bool busyPolling() const { return m_busyPolling; }
+
+		//! Number of messages received
+		uint64_t messages() const { return m_messages.load(std::memory_order_relaxed); }
+
+		//! Number of times the receive thread waited for the consumer to free a slot
+		uint64_t stalls() const { return m_stalls.load(std::memory_order_relaxed); }
+
+		//! Number of times the receive thread blocked because no data arrived
+		uint64_t blocks() const { return m_blocks.load(std::memory_order_relaxed); }
+
+	private:
+		static const size_t CACHE_LINE = 64;
+
+		struct alignas(CACHE_LINE) Slot
+		{
+			Slot() : full(false), bytes(0)
+			{
+			}
+
+			std::atomic<bool> full;
+			size_t bytes;
+			std::vector<char> frame;
+		};
+
+		BusyPollReceiver(const BusyPollReceiver& other);
+
+		void run();
+
+		//! Copy a message into the next slot, waiting until it is free
+		bool publish(const char* frame, size_t bytes);
+
+		int m_socket;
+		int m_spinUs;
+
+		Slot* m_slots;
+		size_t m_slotCount;
+		//! Next slot to fill, receive thread only
+		size_t m_write;
+		//! Next slot to take, consumer only
+		size_t m_read;
+		//! The consumer holds the slot at m_read
+		bool m_holding;
+
+		bool m_pinned;
+		bool m_realtime;
+		bool m_busyPolling;
+
+		std::atomic<bool> m_running;
+		std::atomic<bool> m_closed;
+		std::atomic<uint64_t> m_messages;
+		std::atomic<uint64_t> m_stalls;
+		std::atomic<uint64_t> m_blocks;
+
+		std::thread m_thread;
+	};
+
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Capture.h"
+#include "BufferSocket.h"
+
+#include <stdexcept>
+
+namespace zusi
+{
+
+	CaptureWriter::CaptureWriter(const std::string& filename)
+	{
+		m_file = fopen(filename.c_str(), "wb");
+		if (!m_file)
+			throw std::runtime_error("Capture error - unable to create " + filename);
+
+		//Large buffer, the file is written in big pieces
+		setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+
+		fwrite(capture::MAGIC, 1, sizeof(capture::MAGIC), m_file);
+		fwrite(&capture::VERSION, sizeof(capture::VERSION), 1, m_file);
+	}
+
+	CaptureWriter::~CaptureWriter()
+	{
+		fclose(m_file);
+	}
+
+	void CaptureWriter::write(uint64_t timestamp_ns, const void* frame, uint32_t bytes)
+	{
+		if (fwrite(&timestamp_ns, sizeof(timestamp_ns), 1, m_file) != 1
+			|| fwrite(&bytes, sizeof(bytes), 1, m_file) != 1
+			|| fwrite(frame, 1, bytes, m_file) != bytes)
+			throw std::runtime_error("Capture error - write failed");
+	}
+
+	void CaptureWriter::write(uint64_t timestamp_ns, const Node& msg)
+	{
+		BufferSocket encoded;
+		msg.write(encoded);
+		write(timestamp_ns, encoded.output().data(), static_cast<uint32_t>(encoded.output().size()));
+	}
+
+	void CaptureWriter::flush()
+	{
+		fflush(m_file);
+	}
+
+	CaptureReader::CaptureReader(const void* data, size_t bytes) : m_data(static_cast<const char*>(data)), m_bytes(bytes), m_position(capture::FILE_HEADER_BYTES)
+	{
+		uint32_t version;
+		if (bytes < capture::FILE_HEADER_BYTES || memcmp(data, capture::MAGIC, sizeof(capture::MAGIC)) != 0)
+			throw std::runtime_error("Capture error - not a capture file");
+
+		memcpy(&version, m_data + sizeof(capture::MAGIC), sizeof(version));
+		if (version != capture::VERSION)
+			throw std::runtime_error("Capture error - unsupported version");
+	}
+
+	CaptureReader::CaptureReader(const char* data, size_t begin, size_t end) : m_data(data), m_bytes(end), m_position(begin)
+	{
+	}
+
+	CaptureReader CaptureReader::range(size_t begin, size_t end) const
+	{
+		return CaptureReader(m_data, begin, end < m_bytes ? end : m_bytes);
+	}
+
+	bool CaptureReader::next(uint64_t& timestamp_ns, const char*& frame, uint32_t& bytes)
+	{
+		if (m_bytes - m_position < capture::RECORD_HEADER_BYTES)
+			return false;
+
+		memcpy(&timestamp_ns, m_data + m_position, sizeof(timestamp_ns));
+		memcpy(&bytes, m_data + m_position + sizeof(timestamp_ns), sizeof(bytes));
+
+		if (m_bytes - m_position - capture::RECORD_HEADER_BYTES < bytes)
+			return false;
+
+		frame = m_data + m_position + capture::RECORD_HEADER_BYTES;
+		m_position += capture::RECORD_HEADER_BYTES + bytes;
+		return true;
+	}
+
+}
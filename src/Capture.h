@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <cstdio>
+#include <string>
+
+namespace zusi
+{
+	//! Layout of capture files
+	namespace capture
+	{
+		//! File starts with these 8 bytes, followed by the uint32 format version
+		static const char MAGIC[8] = { 'Z', 'U', 'S', 'I', 'C', 'A', 'P', '\0' };
+		static const uint32_t VERSION = 1;
+		static const size_t FILE_HEADER_BYTES = sizeof(MAGIC) + sizeof(uint32_t);
+
+		//! Each record: uint64 timestamp in nanoseconds, uint32 frame length, then the frame including its message header
+		static const size_t RECORD_HEADER_BYTES = sizeof(uint64_t) + sizeof(uint32_t);
+	}
+
+	/**
+	* @brief Records received messages with time stamps into a capture file
+	*
+	* Messages are stored exactly as they appear on the wire, so captures can be
+	* replayed or analysed later (see CaptureReader).
+	*/
+	class CaptureWriter
+	{
+	public:
+		/**
+		* @brief Create or overwrite a capture file
+		* @throws std::runtime_error if the file cannot be created
+		*/
+		CaptureWriter(const std::string& filename);
+
+		//! Flushes and closes the file
+		~CaptureWriter();
+
+		/**
+		* @brief Append an encoded message
+		* @param timestamp_ns Time the message was received, in nanoseconds
+		* @param frame Message including the message header
+		* @param bytes Size of the message
+		* @throws std::runtime_error on write errors
+		*/
+		void write(uint64_t timestamp_ns, const void* frame, uint32_t bytes);
+
+		//! Encode and append a message
+		void write(uint64_t timestamp_ns, const Node& msg);
+
+		//! Write buffered records to the file
+		void flush();
+
+	private:
+		CaptureWriter(const CaptureWriter& other);
+
+		FILE* m_file;
+		std::vector<char> m_encoded;
+	};
+
+	/**
+	* @brief Iterates over the records of a capture held in memory
+	*
+	* The data is not copied, so it must remain valid while the reader is used.
+	*/
+	class CaptureReader
+	{
+	public:
+		/**
+		* @brief Read a complete capture file
+		* @param data Start of the file
+		* @param bytes Size of the file
+		* @throws std::runtime_error if the file header is not valid
+		*/
+		CaptureReader(const void* data, size_t bytes);
+
+
+		/**
+		* @brief Get the next record
+		* @param timestamp_ns Receives the time stamp
+		* @param frame Receives a pointer to the message
+		* @param bytes Receives the size of the message
+		* @return False at the end of the data. A truncated last record is ignored.
+		*/
+		bool next(uint64_t& timestamp_ns, const char*& frame, uint32_t& bytes);
+
+		//! Offset of the next record from the start of the file
+		size_t position() const { return m_position; }
+
+		/**
+		* @brief Reader for part of the capture, e.g. to process it in chunks
+		* @param begin Offset of the first record, as returned by position()
+		* @param end Offset after the last record, as returned by position()
+		*/
+		CaptureReader range(size_t begin, size_t end) const;
+
+	private:
+		CaptureReader(const char* data, size_t begin, size_t end);
+
+		const char* m_data;
+		size_t m_bytes;
+		size_t m_position;
+	};
+
+}
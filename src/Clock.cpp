@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Clock.h"
+
+#include <stdexcept>
+#include <thread>
+
+namespace zusi
+{
+
+	SystemClock::SystemClock() : m_start(std::chrono::steady_clock::now())
+	{
+	}
+
+	Clock::Duration SystemClock::now()
+	{
+		return std::chrono::duration_cast<Duration>(std::chrono::steady_clock::now() - m_start);
+	}
+
+	void SystemClock::sleepUntil(Duration time)
+	{
+		std::this_thread::sleep_until(m_start + time);
+	}
+
+	ScaledClock::ScaledClock(double factor) : m_start(std::chrono::steady_clock::now()), m_factor(factor)
+	{
+		//Also rejects NaN
+		if (!(factor > 0.0))
+			throw std::runtime_error("Clock error - speed factor must be positive");
+	}
+
+	Clock::Duration ScaledClock::now()
+	{
+		std::chrono::duration<double, std::nano> real = std::chrono::steady_clock::now() - m_start;
+		return Duration(static_cast<Duration::rep>(real.count() * m_factor));
+	}
+
+	void ScaledClock::sleepUntil(Duration time)
+	{
+		std::chrono::duration<double, std::nano> real(time.count() / m_factor);
+		std::this_thread::sleep_until(m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(real));
+	}
+
+	SteppedClock::SteppedClock() : m_now(0)
+	{
+	}
+
+	Clock::Duration SteppedClock::now()
+	{
+		return Duration(m_now.load());
+	}
+
+	void SteppedClock::sleepUntil(Duration time)
+	{
+		int64_t current = m_now.load();
+		while (current < time.count() && !m_now.compare_exchange_weak(current, time.count()));
+	}
+
+	ManualClock::ManualClock() : m_now(0)
+	{
+	}
+
+	Clock::Duration ManualClock::now()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_now;
+	}
+
+	void ManualClock::sleepUntil(Duration time)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_advanced.wait(lock, [&]() { return m_now >= time; });
+	}
+
+	void ManualClock::advance(Duration period)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_now += period;
+		}
+		m_advanced.notify_all();
+	}
+
+	void ManualClock::advanceTo(Duration time)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (time > m_now)
+				m_now = time;
+		}
+		m_advanced.notify_all();
+	}
+
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace zusi
+{
+
+	/**
+	* @brief Abstract source of time for pacing simulations
+	*
+	* Times are measured from the creation of the clock. Code which paces itself
+	* with a Clock instead of std::this_thread::sleep_for() can be run in real
+	* time, faster than real time, or stepped deterministically.
+	*/
+	class Clock
+	{
+	public:
+		//! Time since the clock was created
+		typedef std::chrono::nanoseconds Duration;
+
+		virtual ~Clock() {}
+
+		//! Current time
+		virtual Duration now() = 0;
+
+		//! Block until the clock reaches time
+		virtual void sleepUntil(Duration time) = 0;
+
+		//! Block for a period of clock time
+		void sleepFor(Duration period) { sleepUntil(now() + period); }
+	};
+
+	//! Clock which follows real time
+	class SystemClock : public Clock
+	{
+	public:
+		SystemClock();
+
+		virtual Duration now();
+		virtual void sleepUntil(Duration time);
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	/**
+	* @brief Clock which runs at a multiple of real time
+	*
+	* With a factor of 10 a sleep of one second takes 100ms of real time.
+	*/
+	class ScaledClock : public Clock
+	{
+	public:
+		/**
+		* @param factor Speed relative to real time
+		* @throws std::runtime_error if factor is not positive
+		*/
+		explicit ScaledClock(double factor);
+
+		virtual Duration now();
+		virtual void sleepUntil(Duration time);
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+		double m_factor;
+	};
+
+	/**
+	* @brief Clock which jumps forward instead of sleeping
+	*
+	* Runs as fast as possible while keeping the same sequence of times as
+	* a real-time run, so results are deterministic.
+	*/
+	class SteppedClock : public Clock
+	{
+	public:
+		SteppedClock();
+
+		virtual Duration now();
+		virtual void sleepUntil(Duration time);
+
+	private:
+		std::atomic<int64_t> m_now;
+	};
+
+	/**
+	* @brief Clock which is advanced explicitly by another thread
+	*
+	* sleepUntil() blocks until advance() has moved the clock far enough. A consumer
+	* which advances the clock after handling each message keeps the producer in
+	* lock-step with it.
+	*/
+	class ManualClock : public Clock
+	{
+	public:
+		ManualClock();
+
+		virtual Duration now();
+		virtual void sleepUntil(Duration time);
+
+		//! Move the clock forward and wake any sleepers which are due
+		void advance(Duration period);
+
+		//! Move the clock to time, if it is later than the current time
+		void advanceTo(Duration time);
+
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_advanced;
+		Duration m_now;
+	};
+
+}
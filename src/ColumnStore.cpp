@@ -0,0 +1,640 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ColumnStore.h"
+#include "BufferSocket.h"
+#include "Capture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zusi
+{
+	using namespace column_store;
+
+	typedef std::map<uint16_t, std::vector<ColumnStore::Point>> Columns;
+
+	//! Capture chunks are at least this big, so small captures are not split needlessly
+	static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+	//! Read-only mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string& filename) : m_data(nullptr), m_bytes(0)
+		{
+			int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				throw std::runtime_error("Store error - unable to open " + filename);
+
+			struct stat info;
+			if (fstat(fd, &info) != 0)
+			{
+				::close(fd);
+				throw std::runtime_error("Store error - unable to read " + filename);
+			}
+
+			m_bytes = info.st_size;
+			if (m_bytes > 0)
+			{
+				void* mapped = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+				if (mapped == MAP_FAILED)
+				{
+					::close(fd);
+					throw std::runtime_error("Store error - unable to map " + filename);
+				}
+				m_data = static_cast<const char*>(mapped);
+			}
+			::close(fd);
+		}
+
+		~MappedFile()
+		{
+			if (m_data)
+				munmap(const_cast<char*>(m_data), m_bytes);
+		}
+
+		const char* data() const { return m_data; }
+		size_t size() const { return m_bytes; }
+
+		//! Give up ownership of the mapping
+		void release() { m_data = nullptr; }
+
+	private:
+		MappedFile(const MappedFile& other);
+
+		const char* m_data;
+		size_t m_bytes;
+	};
+
+	//! Most significant bit first
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<char>& dest) : m_dest(dest), m_free(0)
+		{
+		}
+
+		void write(uint32_t value, int bits)
+		{
+			while (bits > 0)
+			{
+				if (m_free == 0)
+				{
+					m_dest.push_back(0);
+					m_free = 8;
+				}
+
+				int count = bits < m_free ? bits : m_free;
+				uint32_t piece = (value >> (bits - count)) & ((1u << count) - 1);
+				m_dest.back() |= static_cast<char>(piece << (m_free - count));
+
+				m_free -= count;
+				bits -= count;
+			}
+		}
+
+	private:
+		std::vector<char>& m_dest;
+		int m_free;
+	};
+
+	class BitReader
+	{
+	public:
+		BitReader(const char* data, size_t bytes) : m_data(reinterpret_cast<const uint8_t*>(data)), m_bytes(bytes), m_bit(0)
+		{
+		}
+
+		uint32_t read(int bits)
+		{
+			uint32_t value = 0;
+			while (bits > 0)
+			{
+				size_t byte = m_bit / 8;
+				if (byte >= m_bytes)
+					throw std::runtime_error("Store error - block data truncated");
+
+				int available = 8 - static_cast<int>(m_bit % 8);
+				int count = bits < available ? bits : available;
+				uint32_t piece = (m_data[byte] >> (available - count)) & ((1u << count) - 1);
+
+				value = (value << count) | piece;
+				m_bit += count;
+				bits -= count;
+			}
+			return value;
+		}
+
+	private:
+		const uint8_t* m_data;
+		size_t m_bytes;
+		size_t m_bit;
+	};
+
+	static void writeVarint(std::vector<char>& dest, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			dest.push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		dest.push_back(static_cast<char>(value));
+	}
+
+	static uint64_t readVarint(const char*& pos, const char* end)
+	{
+		uint64_t value = 0;
+		for (int shift = 0; pos < end && shift < 64; shift += 7)
+		{
+			uint8_t byte = static_cast<uint8_t>(*pos++);
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return value;
+		}
+		throw std::runtime_error("Store error - invalid time stamp");
+	}
+
+	static uint32_t floatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static int leadingZeros(uint32_t value)
+	{
+		int count = 0;
+		for (uint32_t mask = 0x80000000u; mask && !(value & mask); mask >>= 1)
+			++count;
+		return count;
+	}
+
+	static int trailingZeros(uint32_t value)
+	{
+		int count = 0;
+		for (uint32_t mask = 1; mask && !(value & mask); mask <<= 1)
+			++count;
+		return count;
+	}
+
+	//! Compress points into dest, filling in everything in entry except data_offset
+	static void encodeBlock(const ColumnStore::Point* points, uint32_t count, std::vector<char>& dest, BlockEntry& entry)
+	{
+		entry.first_time = points[0].time;
+		entry.last_time = points[count - 1].time;
+		entry.count = count;
+		entry.min = entry.max = points[0].value;
+		entry.sum = 0.0;
+
+		size_t start = dest.size();
+		dest.resize(start + sizeof(uint32_t));
+
+		//Time stamps: zig-zag encoded delta of deltas
+		int64_t last_delta = 0;
+		for (uint32_t i = 1; i < count; ++i)
+		{
+			int64_t delta = static_cast<int64_t>(points[i].time - points[i - 1].time);
+			int64_t dod = delta - last_delta;
+			writeVarint(dest, (static_cast<uint64_t>(dod) << 1) ^ static_cast<uint64_t>(dod >> 63));
+			last_delta = delta;
+		}
+
+		uint32_t time_bytes = static_cast<uint32_t>(dest.size() - start - sizeof(uint32_t));
+		memcpy(dest.data() + start, &time_bytes, sizeof(time_bytes));
+
+		//Values: XOR with the previous value, reusing the previous window of meaningful bits where possible
+		BitWriter bits(dest);
+		uint32_t previous = floatBits(points[0].value);
+		bits.write(previous, 32);
+		int window_leading = -1, window_trailing = 0;
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float value = points[i].value;
+			entry.min = std::min(entry.min, value);
+			entry.max = std::max(entry.max, value);
+			entry.sum += value;
+
+			if (i == 0)
+				continue;
+
+			uint32_t current = floatBits(value);
+			uint32_t x = current ^ previous;
+			previous = current;
+
+			if (x == 0)
+			{
+				bits.write(0, 1);
+				continue;
+			}
+			bits.write(1, 1);
+
+			int leading = std::min(leadingZeros(x), 31);
+			int trailing = trailingZeros(x);
+
+			if (window_leading >= 0 && leading >= window_leading && trailing >= window_trailing)
+			{
+				bits.write(0, 1);
+				bits.write(x >> window_trailing, 32 - window_leading - window_trailing);
+			}
+			else
+			{
+				int meaningful = 32 - leading - trailing;
+				bits.write(1, 1);
+				bits.write(leading, 5);
+				bits.write(meaningful - 1, 5);
+				bits.write(x >> trailing, meaningful);
+				window_leading = leading;
+				window_trailing = trailing;
+			}
+		}
+
+		entry.data_bytes = static_cast<uint32_t>(dest.size() - start);
+	}
+
+	//! Decompress a block and pass each point to the function
+	template <typename Function>
+	static void decodeBlock(const char* data, const BlockEntry& entry, Function f)
+	{
+		uint32_t time_bytes;
+		memcpy(&time_bytes, data, sizeof(time_bytes));
+		if (time_bytes > entry.data_bytes - sizeof(uint32_t))
+			throw std::runtime_error("Store error - invalid block");
+
+		const char* times = data + sizeof(uint32_t);
+		const char* times_end = times + time_bytes;
+		BitReader bits(times_end, entry.data_bytes - sizeof(uint32_t) - time_bytes);
+
+		uint64_t time = entry.first_time;
+		int64_t delta = 0;
+		uint32_t value = bits.read(32);
+		int window_leading = 0, window_trailing = 0;
+
+		for (uint32_t i = 0; i < entry.count; ++i)
+		{
+			if (i > 0)
+			{
+				uint64_t zigzag = readVarint(times, times_end);
+				int64_t dod = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+				delta += dod;
+				time += delta;
+
+				if (bits.read(1))
+				{
+					if (bits.read(1))
+					{
+						window_leading = bits.read(5);
+						int meaningful = bits.read(5) + 1;
+						window_trailing = 32 - window_leading - meaningful;
+					}
+					value ^= bits.read(32 - window_leading - window_trailing) << window_trailing;
+				}
+			}
+
+			float result;
+			memcpy(&result, &value, sizeof(result));
+			f(time, result);
+		}
+	}
+
+	//! Extract the float DATA_FTD values from part of a capture
+	static void decodeChunk(const CaptureReader& records, Columns& columns, uint64_t& record_count)
+	{
+		CaptureReader reader(records);
+		uint64_t time;
+		const char* frame;
+		uint32_t bytes;
+
+		while (reader.next(time, frame, bytes))
+		{
+			++record_count;
+			if (bytes <= sizeof(uint32_t))
+				continue;
+
+			BufferSocket sock(frame + sizeof(uint32_t), bytes - sizeof(uint32_t));
+			Node msg;
+			if (!msg.read(sock) || msg.getId() != MsgType_Fahrpult)
+				continue;
+
+			for (const Node* cmd : msg.nodes)
+			{
+				if (cmd->getId() != Cmd_DATA_FTD)
+					continue;
+
+				for (const Attribute* att : cmd->attributes)
+				{
+					if (att->data_bytes != sizeof(float))
+						continue;
+
+					ColumnStore::Point point;
+					point.time = time;
+					memcpy(&point.value, att->data, sizeof(float));
+					columns[att->getId()].push_back(point);
+				}
+			}
+		}
+	}
+
+	static bool writeAll(FILE* file, const void* data, size_t bytes)
+	{
+		return bytes == 0 || fwrite(data, 1, bytes, file) == bytes;
+	}
+
+	//! Run f(index) for index 0..count-1 on the given number of threads
+	template <typename Function>
+	static void parallelFor(size_t count, unsigned threads, Function f)
+	{
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++)
+				f(i);
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < threads && i < count; ++i)
+			pool.emplace_back(worker);
+		worker();
+		for (std::thread& t : pool)
+			t.join();
+	}
+
+	ColumnStore::ConversionStatistics ColumnStore::convert(const std::string& capture_file, const std::string& store_file, unsigned threads)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+
+		MappedFile capture(capture_file);
+		CaptureReader reader(capture.data(), capture.size());
+
+		//Chunk boundaries: only the record headers are read here
+		size_t chunk_bytes = std::max(MIN_CHUNK_BYTES, capture.size() / (threads * 4));
+		std::vector<size_t> boundaries(1, reader.position());
+		{
+			uint64_t time;
+			const char* frame;
+			uint32_t bytes;
+			while (reader.next(time, frame, bytes))
+				if (reader.position() - boundaries.back() >= chunk_bytes)
+					boundaries.push_back(reader.position());
+			if (reader.position() != boundaries.back())
+				boundaries.push_back(reader.position());
+		}
+		size_t chunk_count = boundaries.size() - 1;
+
+		//Decode the chunks in parallel
+		std::vector<Columns> chunks(chunk_count);
+		std::vector<uint64_t> chunk_records(chunk_count, 0);
+		parallelFor(chunk_count, threads, [&](size_t i) {
+			decodeChunk(reader.range(boundaries[i], boundaries[i + 1]), chunks[i], chunk_records[i]);
+		});
+
+		//Join the chunks of each column in file order
+		Columns columns;
+		for (Columns& chunk : chunks)
+		{
+			for (auto& column : chunk)
+			{
+				std::vector<Point>& dest = columns[column.first];
+				dest.insert(dest.end(), column.second.begin(), column.second.end());
+			}
+			Columns().swap(chunk);
+		}
+
+		//Compress the columns in parallel
+		std::vector<std::pair<uint16_t, std::vector<Point>*>> column_list;
+		for (auto& column : columns)
+			column_list.push_back(std::make_pair(column.first, &column.second));
+
+		std::vector<std::vector<char>> column_data(column_list.size());
+		std::vector<std::vector<BlockEntry>> column_blocks(column_list.size());
+		parallelFor(column_list.size(), threads, [&](size_t i) {
+			//Capture times come from the system clock, which can step back, but the blocks must be in time order
+			std::vector<Point>& points = *column_list[i].second;
+			auto earlier = [](const Point& a, const Point& b) { return a.time < b.time; };
+			if (!std::is_sorted(points.begin(), points.end(), earlier))
+				std::stable_sort(points.begin(), points.end(), earlier);
+
+			for (size_t first = 0; first < points.size(); first += BLOCK_VALUES)
+			{
+				uint32_t count = static_cast<uint32_t>(std::min<size_t>(BLOCK_VALUES, points.size() - first));
+				BlockEntry entry;
+				entry.data_offset = column_data[i].size();
+				encodeBlock(&points[first], count, column_data[i], entry);
+				column_blocks[i].push_back(entry);
+			}
+		});
+
+		//File: header, block data, block indexes, column table
+		FILE* file = fopen(store_file.c_str(), "wb");
+		if (!file)
+			throw std::runtime_error("Store error - unable to create " + store_file);
+
+		FileHeader header = {};
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.column_count = static_cast<uint32_t>(column_list.size());
+		header.first_time = UINT64_MAX;
+		header.last_time = 0;
+
+		ConversionStatistics statistics = {};
+		statistics.columns = column_list.size();
+		statistics.chunks = chunk_count;
+		statistics.threads = threads;
+		for (uint64_t records : chunk_records)
+			statistics.records += records;
+
+		bool ok = writeAll(file, &header, sizeof(header));
+		uint64_t offset = sizeof(header);
+
+		for (size_t i = 0; i < column_list.size(); ++i)
+		{
+			for (BlockEntry& entry : column_blocks[i])
+				entry.data_offset += offset;
+			ok = ok && writeAll(file, column_data[i].data(), column_data[i].size());
+			offset += column_data[i].size();
+		}
+
+		//The index structures are accessed in place, so they must be aligned
+		static const char padding[sizeof(uint64_t)] = {};
+		size_t padding_bytes = (sizeof(uint64_t) - offset % sizeof(uint64_t)) % sizeof(uint64_t);
+		ok = ok && writeAll(file, padding, padding_bytes);
+		offset += padding_bytes;
+
+		std::vector<ColumnEntry> column_table;
+		for (size_t i = 0; i < column_list.size(); ++i)
+		{
+			const std::vector<Point>& points = *column_list[i].second;
+
+			ColumnEntry entry = {};
+			entry.id = column_list[i].first;
+			entry.block_count = static_cast<uint32_t>(column_blocks[i].size());
+			entry.value_count = points.size();
+			entry.blocks_offset = offset;
+			column_table.push_back(entry);
+
+			if (!points.empty())
+			{
+				header.first_time = std::min(header.first_time, points.front().time);
+				header.last_time = std::max(header.last_time, points.back().time);
+			}
+			statistics.values += points.size();
+
+			ok = ok && writeAll(file, column_blocks[i].data(), column_blocks[i].size() * sizeof(BlockEntry));
+			offset += column_blocks[i].size() * sizeof(BlockEntry);
+		}
+
+		header.columns_offset = offset;
+		if (statistics.values == 0)
+			header.first_time = 0;
+
+		ok = ok && writeAll(file, column_table.data(), column_table.size() * sizeof(ColumnEntry));
+		ok = ok && fseek(file, 0, SEEK_SET) == 0 && writeAll(file, &header, sizeof(header));
+		ok = fclose(file) == 0 && ok;
+
+		if (!ok)
+			throw std::runtime_error("Store error - write to " + store_file + " failed");
+
+		return statistics;
+	}
+
+	ColumnStore::ColumnStore(const std::string& filename)
+	{
+		MappedFile file(filename);
+		m_data = file.data();
+		m_bytes = file.size();
+		m_header = reinterpret_cast<const FileHeader*>(m_data);
+
+		if (m_bytes < sizeof(FileHeader) || memcmp(m_header->magic, MAGIC, sizeof(MAGIC)) != 0)
+			throw std::runtime_error("Store error - " + filename + " is not a column store");
+		if (m_header->version != VERSION)
+			throw std::runtime_error("Store error - unsupported version");
+		if (m_header->columns_offset % sizeof(uint64_t) != 0 || m_header->columns_offset + m_header->column_count * sizeof(ColumnEntry) > m_bytes)
+			throw std::runtime_error("Store error - " + filename + " is truncated");
+
+		const ColumnEntry* columns = reinterpret_cast<const ColumnEntry*>(m_data + m_header->columns_offset);
+		for (uint32_t i = 0; i < m_header->column_count; ++i)
+		{
+			if (columns[i].blocks_offset % sizeof(uint64_t) != 0 || columns[i].blocks_offset + columns[i].block_count * sizeof(BlockEntry) > m_bytes)
+				throw std::runtime_error("Store error - " + filename + " is truncated");
+			m_columns[columns[i].id] = &columns[i];
+		}
+
+		file.release();
+	}
+
+	ColumnStore::~ColumnStore()
+	{
+		munmap(const_cast<char*>(m_data), m_bytes);
+	}
+
+	std::vector<uint16_t> ColumnStore::columns() const
+	{
+		std::vector<uint16_t> ids;
+		for (const auto& column : m_columns)
+			ids.push_back(column.first);
+		return ids;
+	}
+
+	std::pair<const BlockEntry*, const BlockEntry*> ColumnStore::blocks(uint16_t id, uint64_t begin, uint64_t end) const
+	{
+		auto column = m_columns.find(id);
+		if (column == m_columns.end())
+			return std::make_pair(nullptr, nullptr);
+
+		const BlockEntry* first = reinterpret_cast<const BlockEntry*>(m_data + column->second->blocks_offset);
+		const BlockEntry* last = first + column->second->block_count;
+
+		//Blocks are in time order, so the range is found by binary search on the index alone
+		first = std::lower_bound(first, last, begin, [](const BlockEntry& block, uint64_t time) { return block.last_time < time; });
+		last = std::upper_bound(first, last, end, [](uint64_t time, const BlockEntry& block) { return time < block.first_time; });
+		return std::make_pair(first, last);
+	}
+
+	ColumnStore::Summary ColumnStore::summarize(uint16_t id, uint64_t begin, uint64_t end) const
+	{
+		Summary summary = {};
+		auto range = blocks(id, begin, end);
+
+		auto add = [&summary](float min, float max) {
+			if (summary.count == 0)
+			{
+				summary.min = min;
+				summary.max = max;
+			}
+			else
+			{
+				summary.min = std::min(summary.min, min);
+				summary.max = std::max(summary.max, max);
+			}
+		};
+
+		for (const BlockEntry* block = range.first; block != range.second; ++block)
+		{
+			//Blocks entirely inside the range are answered from the index
+			if (block->first_time >= begin && block->last_time <= end)
+			{
+				add(block->min, block->max);
+				summary.count += block->count;
+				summary.sum += block->sum;
+				continue;
+			}
+
+			++summary.blocks_decoded;
+			decodeBlock(m_data + block->data_offset, *block, [&](uint64_t time, float value) {
+				if (time < begin || time > end)
+					return;
+				add(value, value);
+				++summary.count;
+				summary.sum += value;
+			});
+		}
+
+		return summary;
+	}
+
+	void ColumnStore::read(uint16_t id, uint64_t begin, uint64_t end, std::vector<Point>& dest) const
+	{
+		auto range = blocks(id, begin, end);
+		for (const BlockEntry* block = range.first; block != range.second; ++block)
+		{
+			decodeBlock(m_data + block->data_offset, *block, [&](uint64_t time, float value) {
+				if (time < begin || time > end)
+					return;
+				Point point;
+				point.time = time;
+				point.value = value;
+				dest.push_back(point);
+			});
+		}
+	}
+
+}
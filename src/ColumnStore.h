@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zusi
+{
+	//! Layout of column store files
+	namespace column_store
+	{
+		static const char MAGIC[8] = { 'Z', 'U', 'S', 'I', 'C', 'O', 'L', '\0' };
+		static const uint32_t VERSION = 1;
+
+		//! Maximum number of values in one block
+		static const uint32_t BLOCK_VALUES = 1024;
+
+		//! Start of the file
+		struct FileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t column_count;
+			uint64_t first_time;
+			uint64_t last_time;
+			//! Offset of column_count ColumnEntry structures
+			uint64_t columns_offset;
+		};
+
+		//! One Fuehrerstand variable
+		struct ColumnEntry
+		{
+			uint16_t id;
+			uint16_t reserved;
+			uint32_t block_count;
+			uint64_t value_count;
+			//! Offset of block_count BlockEntry structures, ordered by time
+			uint64_t blocks_offset;
+		};
+
+		/**
+		* @brief Index entry of one block of values
+		*
+		* The block data starts with the uint32 size of the time stamp section. Time stamps
+		* after the first are stored as zig-zag varints of the difference between consecutive
+		* deltas. Values follow as a bit stream, each XORed with its predecessor and stored
+		* without leading and trailing zero bits (Gorilla encoding).
+		*/
+		struct BlockEntry
+		{
+			uint64_t first_time;
+			uint64_t last_time;
+			uint64_t data_offset;
+			uint32_t data_bytes;
+			uint32_t count;
+			float min;
+			float max;
+			double sum;
+		};
+	}
+
+	/**
+	* @brief Read-only, memory mapped store of recorded Fuehrerstand values (Linux)
+	*
+	* Each DATA_FTD variable is stored as its own column of time stamped values,
+	* compressed in blocks. A per-block index of time range, minimum, maximum and sum
+	* means queries only decode the blocks at the edges of the requested time range.
+	*
+	* Stores are created from capture files with convert().
+	*/
+	class ColumnStore
+	{
+	public:
+		//! A time stamped value
+		struct Point
+		{
+			uint64_t time;
+			float value;
+		};
+
+		//! Aggregate over a time range
+		struct Summary
+		{
+			uint64_t count;
+			float min;
+			float max;
+			double sum;
+			//! Number of blocks which had to be decompressed
+			uint32_t blocks_decoded;
+		};
+
+		//! Result of a conversion
+		struct ConversionStatistics
+		{
+			uint64_t records;
+			uint64_t values;
+			size_t columns;
+			size_t chunks;
+			unsigned threads;
+		};
+
+		/**
+		* @brief Convert a capture file into a column store
+		*
+		* The capture is split into chunks which are decoded in parallel, then the
+		* columns are compressed in parallel. Only DATA_FTD attributes holding a
+		* single float are stored. Values are sorted by time, so captures whose
+		* clock stepped backwards can still be queried.
+		*
+		* @param capture_file Capture written by CaptureWriter
+		* @param store_file Store to create
+		* @param threads Number of threads, 0 to use all cores
+		* @throws std::runtime_error if a file cannot be read or written
+		*/
+		static ConversionStatistics convert(const std::string& capture_file, const std::string& store_file, unsigned threads = 0);
+
+		/**
+		* @brief Open a store for queries
+		* @throws std::runtime_error if the file cannot be mapped or is not a column store
+		*/
+		ColumnStore(const std::string& filename);
+
+		~ColumnStore();
+
+		//! IDs of the stored variables
+		std::vector<uint16_t> columns() const;
+
+		//! Time of the first value in the store
+		uint64_t firstTime() const { return m_header->first_time; }
+
+		//! Time of the last value in the store
+		uint64_t lastTime() const { return m_header->last_time; }
+
+		/**
+		* @brief Count, minimum, maximum and sum of a variable's values in a time range
+		* @param id Variable ID
+		* @param begin Start of the range, inclusive
+		* @param end End of the range, inclusive
+		*/
+		Summary summarize(uint16_t id, uint64_t begin, uint64_t end) const;
+
+		/**
+		* @brief Get a variable's values in a time range
+		* @param id Variable ID
+		* @param begin Start of the range, inclusive
+		* @param end End of the range, inclusive
+		* @param dest Values are appended here
+		*/
+		void read(uint16_t id, uint64_t begin, uint64_t end, std::vector<Point>& dest) const;
+
+	private:
+		ColumnStore(const ColumnStore& other);
+
+		//! Blocks which may contain values in the range
+		std::pair<const column_store::BlockEntry*, const column_store::BlockEntry*> blocks(uint16_t id, uint64_t begin, uint64_t end) const;
+
+		const char* m_data;
+		size_t m_bytes;
+		const column_store::FileHeader* m_header;
+		std::map<uint16_t, const column_store::ColumnEntry*> m_columns;
+	};
+
+}
@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ConcurrentSocket.h"
+
+namespace zusi
+{
+	//! The writer stops joining messages once a write reaches this size
+	static const size_t MAX_WRITE_BYTES = 64 * 1024;
+
+	//! Message being written by the current thread
+	static thread_local std::vector<char> t_message;
+
+	ConcurrentSocket::ConcurrentSocket(Socket* socket) : m_socket(socket), m_parked(false), m_failed(false), m_writes(0), m_messagesSent(0),
+		m_stopping(false)
+	{
+		m_writer = std::thread(&ConcurrentSocket::writerLoop, this);
+	}
+
+	ConcurrentSocket::~ConcurrentSocket()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_one();
+		m_writer.join();
+	}
+
+	int ConcurrentSocket::ReadBytes(void* dest, int bytes)
+	{
+		return m_socket->ReadBytes(dest, bytes);
+	}
+
+	int ConcurrentSocket::WriteBytes(const void* src, int bytes)
+	{
+		const char* src_chars = static_cast<const char*>(src);
+		t_message.insert(t_message.end(), src_chars, src_chars + bytes);
+		return bytes;
+	}
+
+	bool ConcurrentSocket::DataToRead()
+	{
+		return m_socket->DataToRead();
+	}
+
+	int ConcurrentSocket::BytesAvailable()
+	{
+		return m_socket->BytesAvailable();
+	}
+
+	bool ConcurrentSocket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		return m_socket->WaitReadable(timeout);
+	}
+
+	bool ConcurrentSocket::Flush()
+	{
+		if (m_failed)
+		{
+			t_message.clear();
+			return false;
+		}
+
+		m_queue.push(std::move(t_message));
+		t_message = std::vector<char>();
+
+		//Pairs with park(): either the writer sees the message or we see that it is parked
+		if (m_parked.exchange(false))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_wake.notify_one();
+		}
+		return true;
+	}
+
+	bool ConcurrentSocket::park()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_parked = true;
+		if (m_queue.empty())
+			m_wake.wait(lock, [this]() { return !m_parked || m_stopping; });
+
+		m_parked = false;
+		return !m_stopping;
+	}
+
+	void ConcurrentSocket::writerLoop()
+	{
+		std::vector<char> batch;
+		std::vector<char> message;
+
+		while (park())
+		{
+			while (true)
+			{
+				//Join everything waiting into one write
+				batch.clear();
+				uint64_t count = 0;
+				while (batch.size() < MAX_WRITE_BYTES && m_queue.pop(message))
+				{
+					if (batch.empty())
+						batch.swap(message);
+					else
+						batch.insert(batch.end(), message.begin(), message.end());
+					++count;
+				}
+
+				if (count == 0)
+					break;
+				if (m_failed)
+					continue;
+
+				int written = m_socket->WriteBytes(batch.data(), static_cast<int>(batch.size()));
+				if (written != static_cast<int>(batch.size()) || !m_socket->Flush())
+				{
+					m_failed = true;
+					continue;
+				}
+
+				++m_writes;
+				m_messagesSent += count;
+			}
+		}
+	}
+
+}
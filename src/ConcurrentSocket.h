@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "MpscQueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace zusi
+{
+
+	/**
+	* @brief Socket which any number of threads can send messages through at the same time
+	*
+	* Each thread writes its message (WriteBytes() followed by Flush()) into a buffer of
+	* its own, and Flush() hands the complete message to a writer thread through an
+	* MpscQueue. The writer joins all waiting messages into as few writes to the wrapped
+	* socket as possible. Senders never wait for the socket or for each other; the
+	* writer's mutex is only taken to wake it when it has run out of work.
+	*
+	* This makes the send methods of a Connection using this socket safe to call from
+	* several threads. Reads are passed straight through and must stay on one thread.
+	* The message buffer belongs to the thread, so a thread must flush one message
+	* before writing another, to this or any other ConcurrentSocket.
+	*/
+	class ConcurrentSocket :
+		public zusi::Socket
+	{
+	public:
+		/**
+		* @brief Start the writer thread
+		* @param socket The socket to send with - class does not take ownership of it
+		*/
+		ConcurrentSocket(Socket* socket);
+
+		/**
+		* @brief Stop the writer thread, discarding unsent data
+		*
+		* Waits for a write in progress. If the peer may have stopped reading,
+		* shut down the connection first.
+		*/
+		virtual ~ConcurrentSocket();
+
+		virtual int ReadBytes(void* dest, int bytes);
+
+		//! Append to the calling thread's current message
+		virtual int WriteBytes(const void* src, int bytes);
+
+		virtual bool DataToRead();
+		virtual int BytesAvailable();
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
+
+		/**
+		* @brief Queue the calling thread's current message
+		* @return False if an earlier write to the wrapped socket has failed
+		*/
+		virtual bool Flush();
+
+		//! Number of writes made to the wrapped socket
+		uint64_t writes() const { return m_writes; }
+
+		//! Number of messages sent
+		uint64_t messagesSent() const { return m_messagesSent; }
+
+	private:
+		ConcurrentSocket(const ConcurrentSocket& other);
+
+		void writerLoop();
+
+		/**
+		* @brief Wait until a message is queued
+		* @return False if the socket is being destroyed
+		*/
+		bool park();
+
+		Socket* m_socket;
+		MpscQueue<std::vector<char>> m_queue;
+
+		std::atomic<bool> m_parked;
+		std::atomic<bool> m_failed;
+		std::atomic<uint64_t> m_writes;
+		std::atomic<uint64_t> m_messagesSent;
+
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_stopping;
+
+		std::thread m_writer;
+	};
+
+}
@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Dispatcher.h"
+
+namespace zusi
+{
+
+	Dispatcher::Dispatcher()
+	{
+	}
+
+	void Dispatcher::onFloat(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(float)> handler)
+	{
+		onAttribute(msg, cmd, id, [handler](FrameReader& reader) { handler(reader.valueFloat()); });
+	}
+
+	void Dispatcher::onUint16(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(uint16_t)> handler)
+	{
+		onAttribute(msg, cmd, id, [handler](FrameReader& reader) { handler(reader.valueUint16()); });
+	}
+
+	void Dispatcher::onInt16(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(int16_t)> handler)
+	{
+		onAttribute(msg, cmd, id, [handler](FrameReader& reader) { handler(reader.valueInt16()); });
+	}
+
+	void Dispatcher::onUint8(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(uint8_t)> handler)
+	{
+		onAttribute(msg, cmd, id, [handler](FrameReader& reader) { handler(reader.valueUint8()); });
+	}
+
+	void Dispatcher::onBytes(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(const char*, uint32_t)> handler)
+	{
+		onAttribute(msg, cmd, id, [handler](FrameReader& reader) { handler(reader.data(), reader.dataBytes()); });
+	}
+
+	void Dispatcher::onAttribute(uint16_t msg, uint16_t cmd, uint16_t id, Handler handler)
+	{
+		set(table(msg, cmd).attributes, id, std::move(handler));
+	}
+
+	void Dispatcher::onNode(uint16_t msg, uint16_t cmd, uint16_t id, Handler handler)
+	{
+		set(table(msg, cmd).nodes, id, std::move(handler));
+	}
+
+	void Dispatcher::onCommandEnd(uint16_t msg, uint16_t cmd, std::function<void()> handler)
+	{
+		table(msg, cmd).end = std::move(handler);
+	}
+
+	bool Dispatcher::dispatch(FrameReader& reader) const
+	{
+		const uint16_t msg = reader.messageType();
+		const CommandTable* command = nullptr;
+
+		while (reader.next())
+		{
+			const int depth = reader.depth();
+			switch (reader.item())
+			{
+			case FrameReader::Item_NodeStart:
+				if (depth == 1)
+				{
+					command = findTable(msg, reader.id());
+					if (!command)
+						reader.skipNode();
+				}
+				else if (depth == 2 && command)
+				{
+					const Handler* handler = find(command->nodes, reader.id());
+					if (!handler)
+					{
+						reader.skipNode();
+						break;
+					}
+
+					(*handler)(reader);
+
+					//Skip whatever the handler left of the sub-node
+					while (!(reader.item() == FrameReader::Item_NodeEnd && reader.depth() == depth))
+					{
+						if (!reader.next())
+							return !reader.failed();
+					}
+				}
+				else
+				{
+					reader.skipNode();
+				}
+				break;
+
+			case FrameReader::Item_Attribute:
+				if (depth == 1 && command)
+				{
+					const Handler* handler = find(command->attributes, reader.id());
+					if (handler)
+						(*handler)(reader);
+				}
+				break;
+
+			case FrameReader::Item_NodeEnd:
+				if (depth == 1 && command)
+				{
+					if (command->end)
+						command->end();
+					command = nullptr;
+				}
+				break;
+			}
+		}
+
+		return !reader.failed();
+	}
+
+	bool Dispatcher::dispatch(const void* frame, size_t bytes) const
+	{
+		FrameReader reader(frame, bytes);
+		return dispatch(reader);
+	}
+
+	Dispatcher::CommandTable& Dispatcher::table(uint16_t msg, uint16_t cmd)
+	{
+		if (m_index.size() <= msg)
+			m_index.resize(msg + 1);
+
+		std::vector<int>& commands = m_index[msg];
+		if (commands.size() <= cmd)
+			commands.resize(cmd + 1, -1);
+
+		if (commands[cmd] < 0)
+		{
+			commands[cmd] = static_cast<int>(m_tables.size());
+			m_tables.push_back(CommandTable());
+		}
+
+		return m_tables[commands[cmd]];
+	}
+
+	const Dispatcher::CommandTable* Dispatcher::findTable(uint16_t msg, uint16_t cmd) const
+	{
+		if (msg >= m_index.size() || cmd >= m_index[msg].size() || m_index[msg][cmd] < 0)
+			return nullptr;
+
+		return &m_tables[m_index[msg][cmd]];
+	}
+
+	void Dispatcher::set(std::vector<Handler>& handlers, uint16_t id, Handler handler)
+	{
+		if (handlers.size() <= id)
+			handlers.resize(id + 1);
+
+		handlers[id] = std::move(handler);
+	}
+
+	const Dispatcher::Handler* Dispatcher::find(const std::vector<Handler>& handlers, uint16_t id)
+	{
+		if (id >= handlers.size() || !handlers[id])
+			return nullptr;
+
+		return &handlers[id];
+	}
+
+}
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "FrameReader.h"
+
+#include <functional>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Routes the contents of received messages to handlers registered by ID
+	*
+	* Handlers are registered for a (MsgType, Command, ID) combination and kept in
+	* tables indexed by those IDs, so dispatching walks each message once and finds
+	* the handler for every item with a few array lookups, however many handlers are
+	* registered. Items without a handler are skipped.
+	*
+	* Registering a handler for a combination which already has one replaces it.
+	* Handlers must not register further handlers while a message is dispatched.
+	*
+	* @code
+	* Dispatcher dispatcher;
+	* dispatcher.onFloat(MsgType_Fahrpult, Cmd_DATA_FTD, Fs_Geschwindigkeit, [&](float v) { speed = v; });
+	* dispatcher.onNode(MsgType_Fahrpult, Cmd_DATA_OPERATION, 1, [&](FrameReader& input) { ... });
+	*
+	* FrameReader reader;
+	* while (con.receiveFrame(reader))
+	*     dispatcher.dispatch(reader);
+	* @endcode
+	*/
+	class Dispatcher
+	{
+	public:
+		//! Handler for an attribute or node, called with the reader positioned at it
+		typedef std::function<void(FrameReader&)> Handler;
+
+		Dispatcher();
+
+		//! Call handler with each Single attribute id in command nodes cmd of messages of type msg
+		void onFloat(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(float)> handler);
+
+		//! Call handler with each Word attribute id in command nodes cmd of messages of type msg
+		void onUint16(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(uint16_t)> handler);
+
+		//! Call handler with each SmallInt attribute id in command nodes cmd of messages of type msg
+		void onInt16(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(int16_t)> handler);
+
+		//! Call handler with each Byte attribute id in command nodes cmd of messages of type msg
+		void onUint8(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(uint8_t)> handler);
+
+		//! Call handler with the data of each attribute id in command nodes cmd of messages of type msg
+		void onBytes(uint16_t msg, uint16_t cmd, uint16_t id, std::function<void(const char*, uint32_t)> handler);
+
+		/**
+		* @brief Call handler for each attribute id in command nodes cmd of messages of type msg
+		*
+		* Use this for other types or to check the size with FrameReader::dataBytes().
+		*/
+		void onAttribute(uint16_t msg, uint16_t cmd, uint16_t id, Handler handler);
+
+		/**
+		* @brief Call handler for each sub-node id in command nodes cmd of messages of type msg
+		*
+		* The reader is positioned at the start of the sub-node. The handler may read its
+		* contents with FrameReader::next(), at most up to the sub-node's end; whatever it
+		* leaves is skipped.
+		*/
+		void onNode(uint16_t msg, uint16_t cmd, uint16_t id, Handler handler);
+
+		//! Call handler after each command node cmd of messages of type msg, e.g. to apply a complete update
+		void onCommandEnd(uint16_t msg, uint16_t cmd, std::function<void()> handler);
+
+		/**
+		* @brief Pass the contents of a message to the registered handlers
+		* @param reader Reader positioned at the start of the message, e.g. by Connection::receiveFrame()
+		* @return False if the message is invalid; handlers may have been called for its valid part
+		*/
+		bool dispatch(FrameReader& reader) const;
+
+		/**
+		* @brief Pass the contents of a message to the registered handlers
+		* @param frame Message including the message header
+		* @param bytes Size of the message
+		* @return False if the message is invalid; handlers may have been called for its valid part
+		*/
+		bool dispatch(const void* frame, size_t bytes) const;
+
+	private:
+		//! Handlers for one command of one message type
+		struct CommandTable
+		{
+			std::vector<Handler> attributes;
+			std::vector<Handler> nodes;
+			std::function<void()> end;
+		};
+
+		CommandTable& table(uint16_t msg, uint16_t cmd);
+		const CommandTable* findTable(uint16_t msg, uint16_t cmd) const;
+
+		static void set(std::vector<Handler>& handlers, uint16_t id, Handler handler);
+		static const Handler* find(const std::vector<Handler>& handlers, uint16_t id);
+
+		//! Index into m_tables by message type and command, -1 where nothing is registered
+		std::vector<std::vector<int>> m_index;
+		std::vector<CommandTable> m_tables;
+	};
+
+}
@@ -0,0 +1,443 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "EpollReactor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace zusi
+{
+	static const size_t READ_CHUNK = 64 * 1024;
+	//! Reads per readiness event, so a busy connection cannot starve the others. Epoll is level-triggered and reports the rest again.
+	static const int MAX_READS_PER_EVENT = 4;
+	static const int MAX_EVENTS = 64;
+
+	//! Socket which collects outgoing data until the reactor flushes it
+	class EpollReactor::ReactorSocket :
+		public zusi::Socket
+	{
+	public:
+		ReactorSocket(EpollReactor* owner, Entry* entry) : m_owner(owner), m_entry(entry), m_sent(0)
+		{
+		}
+
+		//! Receiving is done by the reactor
+		virtual int ReadBytes(void*, int) { return -1; }
+
+		virtual int WriteBytes(const void* src, int bytes)
+		{
+			m_owner->markDirty(m_entry);
+
+			const char* src_chars = static_cast<const char*>(src);
+			m_pending.insert(m_pending.end(), src_chars, src_chars + bytes);
+			return bytes;
+		}
+
+		virtual bool DataToRead() { return false; }
+
+		EpollReactor* m_owner;
+		Entry* m_entry;
+
+		std::vector<char> m_pending;
+		size_t m_sent;
+	};
+
+	enum EntryState
+	{
+		State_Connecting,
+		State_AwaitHelloAck,
+		State_AwaitNeededDataAck,
+		State_Established,
+		State_Closed
+	};
+
+	struct EpollReactor::Entry
+	{
+		Entry(EpollReactor* owner, int socket) : fd(socket), state(State_Connecting), socket(owner, this), connection(&this->socket), want_write(true), dirty(false)
+		{
+		}
+
+		int fd;
+		EntryState state;
+		ReactorSocket socket;
+		ClientConnection connection;
+		FrameBuffer input;
+		ClientHandlers handlers;
+
+		std::string client_id;
+		std::vector<FuehrerstandData> fs_data;
+		std::vector<ProgData> prog_data;
+		bool bedienung;
+		bool pipelined;
+
+		bool want_write;
+		bool dirty;
+	};
+
+	EpollReactor::EpollReactor() : m_running(false), m_haveClosed(false)
+	{
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (m_epoll < 0)
+			throw std::runtime_error("Reactor error - epoll creation failed");
+
+		m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_wakeup < 0)
+		{
+			::close(m_epoll);
+			throw std::runtime_error("Reactor error - eventfd creation failed");
+		}
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+	}
+
+	EpollReactor::~EpollReactor()
+	{
+		for (auto& entry : m_entries)
+			if (entry->state != State_Closed)
+				::close(entry->fd);
+
+		::close(m_wakeup);
+		::close(m_epoll);
+	}
+
+	ClientConnection& EpollReactor::addClient(const char* ip_address, int port, const char* client_id,
+		const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung,
+		const ClientHandlers& handlers, bool pipelined)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+		if (fd < 0)
+			throw std::runtime_error("Socket error - Socket creation Failed!");
+
+		int flag = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+		sockaddr_in sock_addr = {};
+		sock_addr.sin_port = htons(port);
+		sock_addr.sin_family = AF_INET;
+		inet_pton(AF_INET, ip_address, &(sock_addr.sin_addr));
+
+		if (::connect(fd, reinterpret_cast<sockaddr*>(&sock_addr), sizeof(sock_addr)) != 0 && errno != EINPROGRESS)
+		{
+			::close(fd);
+			throw std::runtime_error("Failed to establish connection with server");
+		}
+
+		m_entries.emplace_back(new Entry(this, fd));
+		Entry& entry = *m_entries.back();
+		entry.handlers = handlers;
+		entry.client_id = client_id;
+		entry.fs_data = fs_data;
+		entry.prog_data = prog_data;
+		entry.bedienung = bedienung;
+		entry.pipelined = pipelined;
+
+		//Connection is complete when the socket becomes writable
+		epoll_event ev = {};
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.ptr = &entry;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+		{
+			::close(fd);
+			m_entries.pop_back();
+			throw std::runtime_error("Reactor error - unable to register socket");
+		}
+
+		return entry.connection;
+	}
+
+	int EpollReactor::runOnce(int timeout_ms)
+	{
+		flushDirty();
+
+		epoll_event events[MAX_EVENTS];
+		int count = epoll_wait(m_epoll, events, MAX_EVENTS, timeout_ms);
+		if (count < 0)
+			return 0;
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.ptr == nullptr)
+			{
+				uint64_t value;
+				while (read(m_wakeup, &value, sizeof(value)) > 0);
+				continue;
+			}
+
+			Entry& entry = *static_cast<Entry*>(events[i].data.ptr);
+			if (entry.state != State_Closed)
+				handleEvent(entry, events[i].events);
+		}
+
+		flushDirty();
+		removeClosed();
+
+		return count;
+	}
+
+	void EpollReactor::run()
+	{
+		m_running = true;
+		while (m_running && connectionCount() > 0)
+			runOnce(-1);
+		m_running = false;
+	}
+
+	void EpollReactor::stop()
+	{
+		m_running = false;
+		uint64_t value = 1;
+		write(m_wakeup, &value, sizeof(value));
+	}
+
+	size_t EpollReactor::connectionCount() const
+	{
+		size_t count = 0;
+		for (const auto& entry : m_entries)
+			if (entry->state != State_Closed)
+				++count;
+		return count;
+	}
+
+	void EpollReactor::handleEvent(Entry& entry, uint32_t events)
+	{
+		if (entry.state == State_Connecting)
+		{
+			if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+				return;
+
+			int error = 0;
+			socklen_t length = sizeof(error);
+			getsockopt(entry.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+			if (error != 0)
+			{
+				close(entry, "Failed to establish connection with server");
+				return;
+			}
+
+			handleConnected(entry);
+		}
+
+		if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			if (!handleReadable(entry))
+				return;
+
+		if ((events & EPOLLOUT) && entry.state != State_Closed)
+			flush(entry);
+	}
+
+	void EpollReactor::handleConnected(Entry& entry)
+	{
+		entry.state = State_AwaitHelloAck;
+		entry.connection.sendHello(entry.client_id.c_str());
+
+		//Both messages end up in the same write when the loop flushes
+		if (entry.pipelined)
+			entry.connection.sendNeededData(entry.fs_data, entry.prog_data, entry.bedienung);
+	}
+
+	bool EpollReactor::handleReadable(Entry& entry)
+	{
+		for (int reads = 0; reads < MAX_READS_PER_EVENT; ++reads)
+		{
+			char* dest = entry.input.prepare(READ_CHUNK);
+			ssize_t received = recv(entry.fd, dest, READ_CHUNK, 0);
+
+			if (received > 0)
+			{
+				entry.input.commit(received);
+				continue;
+			}
+
+			if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+			if (received < 0 && errno == EINTR)
+				continue;
+
+			//Deliver what was received before the connection closed
+			try
+			{
+				while (entry.state != State_Closed)
+				{
+					Node msg;
+					if (!entry.input.nextMessage(msg))
+						break;
+					handleMessage(entry, msg);
+				}
+			}
+			catch (std::runtime_error&)
+			{
+			}
+
+			if (entry.state != State_Closed)
+				close(entry, received == 0 ? "Connection closed by server" : strerror(errno));
+			return false;
+		}
+
+		try
+		{
+			while (entry.state != State_Closed)
+			{
+				Node msg;
+				if (!entry.input.nextMessage(msg))
+					break;
+				handleMessage(entry, msg);
+			}
+		}
+		catch (std::runtime_error& e)
+		{
+			close(entry, e.what());
+			return false;
+		}
+
+		return entry.state != State_Closed;
+	}
+
+	void EpollReactor::handleMessage(Entry& entry, const Node& msg)
+	{
+		switch (entry.state)
+		{
+		case State_AwaitHelloAck:
+			entry.connection.processHelloAck(msg);
+			if (!entry.pipelined)
+				entry.connection.sendNeededData(entry.fs_data, entry.prog_data, entry.bedienung);
+			entry.state = State_AwaitNeededDataAck;
+			break;
+		case State_AwaitNeededDataAck:
+			entry.connection.processNeededDataAck(msg);
+			entry.state = State_Established;
+			if (entry.handlers.connected)
+				entry.handlers.connected(entry.connection);
+			break;
+		case State_Established:
+			if (entry.handlers.message)
+				entry.handlers.message(entry.connection, msg);
+			break;
+		default:
+			break;
+		}
+	}
+
+	bool EpollReactor::flush(Entry& entry)
+	{
+		ReactorSocket& sock = entry.socket;
+
+		while (sock.m_sent < sock.m_pending.size())
+		{
+			ssize_t sent = send(entry.fd, sock.m_pending.data() + sock.m_sent, sock.m_pending.size() - sock.m_sent, MSG_NOSIGNAL);
+			if (sent < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				close(entry, strerror(errno));
+				return false;
+			}
+			sock.m_sent += sent;
+		}
+
+		bool complete = sock.m_sent == sock.m_pending.size();
+		if (complete)
+		{
+			sock.m_pending.clear();
+			sock.m_sent = 0;
+		}
+
+		updateEvents(entry, !complete);
+		return true;
+	}
+
+	void EpollReactor::flushDirty()
+	{
+		//flush() may close entries but never adds to the list
+		for (size_t i = 0; i < m_dirty.size(); ++i)
+		{
+			Entry* entry = m_dirty[i];
+			entry->dirty = false;
+			if (entry->state != State_Closed && entry->state != State_Connecting)
+				flush(*entry);
+		}
+		m_dirty.clear();
+	}
+
+	void EpollReactor::updateEvents(Entry& entry, bool want_write)
+	{
+		if (entry.want_write == want_write)
+			return;
+
+		epoll_event ev = {};
+		ev.events = want_write ? static_cast<uint32_t>(EPOLLIN | EPOLLOUT) : static_cast<uint32_t>(EPOLLIN);
+		ev.data.ptr = &entry;
+		epoll_ctl(m_epoll, EPOLL_CTL_MOD, entry.fd, &ev);
+		entry.want_write = want_write;
+	}
+
+	void EpollReactor::close(Entry& entry, const std::string& reason)
+	{
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, entry.fd, nullptr);
+		::close(entry.fd);
+		entry.state = State_Closed;
+		m_haveClosed = true;
+
+		if (entry.handlers.closed)
+			entry.handlers.closed(entry.connection, reason);
+	}
+
+	void EpollReactor::removeClosed()
+	{
+		if (!m_haveClosed)
+			return;
+
+		for (auto it = m_entries.begin(); it != m_entries.end();)
+		{
+			if ((*it)->state == State_Closed && !(*it)->dirty)
+				it = m_entries.erase(it);
+			else
+				++it;
+		}
+		m_haveClosed = false;
+	}
+
+	void EpollReactor::markDirty(Entry* entry)
+	{
+		if (entry->dirty)
+			return;
+		entry->dirty = true;
+		m_dirty.push_back(entry);
+	}
+
+}
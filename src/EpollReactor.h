@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "FrameBuffer.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Runs many client connections from a single thread using Linux epoll
+	*
+	* Each connection owns a non-blocking socket. The handshake (HELLO/NEEDED_DATA)
+	* and message decoding are driven by the event loop, and complete messages are
+	* passed to the handlers registered for the connection.
+	*
+	* The ClientConnection objects handed to the handlers may be used to send
+	* (e.g. ClientConnection::sendInput()) from within a handler. Outgoing data is
+	* buffered and written when the handler returns. Blocking receive functions
+	* must not be used on these connections. All functions except stop() must
+	* be called from the thread running the loop.
+	*/
+	class EpollReactor
+	{
+	public:
+
+		//! Callbacks for events on one connection
+		struct ClientHandlers
+		{
+			//! Called when the handshake has completed
+			std::function<void(ClientConnection&)> connected;
+			//! Called for each message received after the handshake
+			std::function<void(ClientConnection&, const Node&)> message;
+			//! Called once when the connection is closed, with the reason
+			std::function<void(ClientConnection&, const std::string&)> closed;
+		};
+
+		/**
+		* @brief Create an reactor with no connections
+		* @throws std::runtime_error if the epoll instance cannot be created
+		*/
+		EpollReactor();
+
+		//! Closes all remaining connections without calling their handlers
+		~EpollReactor();
+
+		/**
+		* @brief Start connecting to a Zusi server
+		*
+		* The connection and handshake complete asynchronously while the loop runs.
+		*
+		* @param ip_address Null-terminated string of IP Address to connect to
+		* @param port Port to connection to, usually 1436.
+		* @param client_id Null-terminated character array with an identification string for the client
+		* @param fs_data Fuehrerstand Data ID's to subscribe to
+		* @param prog_data Zusi program status ID's to subscribe to
+		* @param bedienung Subscribe to input events if true
+		* @param handlers Callbacks for this connection
+		* @param pipelined Send NEEDED_DATA together with HELLO, see ClientConnection::connect()
+		* @return The connection. It remains valid until the closed handler has returned.
+		* @throws std::runtime_error if the socket cannot be created
+		*/
+		ClientConnection& addClient(const char* ip_address, int port, const char* client_id,
+			const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung,
+			const ClientHandlers& handlers, bool pipelined = false);
+
+		/**
+		* @brief Wait for and process events
+		* @param timeout_ms Maximum time to wait in milliseconds, -1 to wait forever
+		* @return Number of events processed
+		*/
+		int runOnce(int timeout_ms);
+
+		//! Process events until stop() is called or no connections are left
+		void run();
+
+		//! Make run() return. May be called from any thread.
+		void stop();
+
+		//! Number of connections which have not been closed
+		size_t connectionCount() const;
+
+	private:
+		class ReactorSocket;
+		struct Entry;
+
+		EpollReactor(const EpollReactor& other);
+
+		void handleEvent(Entry& entry, uint32_t events);
+		void handleConnected(Entry& entry);
+		bool handleReadable(Entry& entry);
+		void handleMessage(Entry& entry, const Node& msg);
+		bool flush(Entry& entry);
+		void flushDirty();
+		void updateEvents(Entry& entry, bool want_write);
+		void close(Entry& entry, const std::string& reason);
+		void removeClosed();
+
+		void markDirty(Entry* entry);
+
+		int m_epoll;
+		int m_wakeup;
+		std::atomic<bool> m_running;
+
+		std::vector<std::unique_ptr<Entry>> m_entries;
+		std::vector<Entry*> m_dirty;
+		bool m_haveClosed;
+	};
+
+}
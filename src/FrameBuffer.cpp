@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "FrameBuffer.h"
+#include "BufferSocket.h"
+
+#include <cstring>
+
+namespace zusi
+{
+	static const uint32_t NODE_START = 0;
+	static const uint32_t NODE_END = 0xFFFFFFFF;
+
+	FrameBuffer::FrameBuffer() : m_begin(0), m_end(0), m_scanPos(0), m_scanDepth(0)
+	{
+	}
+
+	char* FrameBuffer::prepare(size_t bytes)
+	{
+		if (m_data.size() - m_end < bytes)
+		{
+			//Move unconsumed data to the front before growing
+			if (m_begin > 0)
+			{
+				memmove(m_data.data(), m_data.data() + m_begin, m_end - m_begin);
+				m_end -= m_begin;
+				m_begin = 0;
+			}
+
+			if (m_data.size() - m_end < bytes)
+				m_data.resize(m_end + bytes);
+		}
+
+		return m_data.data() + m_end;
+	}
+
+	void FrameBuffer::commit(size_t bytes)
+	{
+		m_end += bytes;
+	}
+
+	void FrameBuffer::append(const void* src, size_t bytes)
+	{
+		memcpy(prepare(bytes), src, bytes);
+		commit(bytes);
+	}
+
+	size_t FrameBuffer::frameLength()
+	{
+		const char* base = data();
+		size_t available = size();
+
+		while (m_scanPos + sizeof(uint32_t) <= available)
+		{
+			uint32_t next_length;
+			memcpy(&next_length, base + m_scanPos, sizeof(next_length));
+
+			if (m_scanDepth == 0 && next_length != NODE_START)
+				throw std::runtime_error("Protocol error - invalid message header");
+
+			if (next_length == NODE_START)
+			{
+				if (m_scanPos + sizeof(uint32_t) + sizeof(uint16_t) > available)
+					return 0;
+				m_scanPos += sizeof(uint32_t) + sizeof(uint16_t);
+				++m_scanDepth;
+			}
+			else if (next_length == NODE_END)
+			{
+				m_scanPos += sizeof(uint32_t);
+				if (--m_scanDepth == 0)
+					return m_scanPos;
+			}
+			else
+			{
+				if (next_length < sizeof(uint16_t))
+					throw std::runtime_error("Protocol error - invalid attribute length");
+				if (m_scanPos + sizeof(uint32_t) + next_length > available)
+					return 0;
+				m_scanPos += sizeof(uint32_t) + next_length;
+			}
+		}
+
+		return 0;
+	}
+
+	bool FrameBuffer::nextMessage(Node& dest)
+	{
+		size_t length = frameLength();
+		if (length == 0)
+			return false;
+
+		//Skip the message header, Node::read() expects the ID next
+		BufferSocket sock(data() + sizeof(uint32_t), length - sizeof(uint32_t));
+		bool result = dest.read(sock);
+
+		consume(length);
+		return result;
+	}
+
+	void FrameBuffer::consume(size_t bytes)
+	{
+		m_begin += bytes;
+		if (m_begin >= m_end)
+			m_begin = m_end = 0;
+
+		m_scanPos = 0;
+		m_scanDepth = 0;
+	}
+
+	void FrameBuffer::clear()
+	{
+		m_begin = m_end = 0;
+		m_scanPos = 0;
+		m_scanDepth = 0;
+	}
+
+}
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+namespace zusi
+{
+
+	/**
+	* @brief Accumulates received bytes and splits them into complete messages
+	*
+	* Used where data arrives in arbitrary pieces, e.g. from a non-blocking socket.
+	* The scan for the end of a message is resumed where it stopped, so a message
+	* delivered in many small pieces is only scanned once.
+	*/
+	class FrameBuffer
+	{
+	public:
+		FrameBuffer();
+
+		/**
+		* @brief Reserve space at the end of the buffer for incoming data
+		* @param bytes Number of bytes which will be written
+		* @return Pointer to write to. Call commit() afterwards with the number of bytes actually written.
+		*/
+		char* prepare(size_t bytes);
+
+		//! Mark bytes written to the pointer returned by prepare() as received
+		void commit(size_t bytes);
+
+		//! Copy received bytes into the buffer
+		void append(const void* src, size_t bytes);
+
+		/**
+		* @brief Length of the complete message at the front of the buffer
+		* @return Message length in bytes including header, or 0 if the message is not complete yet
+		* @throws std::runtime_error if the data is not a valid message
+		*/
+		size_t frameLength();
+
+		/**
+		* @brief Decode the message at the front of the buffer and remove it
+		* @param dest Empty node to decode into
+		* @return True if a message was decoded, false if the message is not complete yet
+		* @throws std::runtime_error if the data is not a valid message
+		*/
+		bool nextMessage(Node& dest);
+
+		//! Remove bytes from the front of the buffer
+		void consume(size_t bytes);
+
+		//! Buffered data
+		const char* data() const { return m_data.data() + m_begin; }
+
+		//! Number of buffered bytes
+		size_t size() const { return m_end - m_begin; }
+
+		//! Discard all buffered data
+		void clear();
+
+	private:
+		std::vector<char> m_data;
+		size_t m_begin;
+		size_t m_end;
+
+		//Resumable scan state, relative to m_begin
+		size_t m_scanPos;
+		int m_scanDepth;
+	};
+
+}
@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "FrameReader.h"
+
+namespace zusi
+{
+	static const uint32_t NODE_START = 0;
+	static const uint32_t NODE_END = 0xFFFFFFFF;
+
+	FrameReader::FrameReader() : m_frame(nullptr), m_frameBytes(0), m_pos(nullptr), m_end(nullptr), m_messageType(0), m_level(0), m_item(Item_NodeEnd), m_id(0), m_depth(0),
+		m_data(nullptr), m_dataBytes(0), m_failed(false)
+	{
+	}
+
+	FrameReader::FrameReader(const void* frame, size_t bytes) : FrameReader()
+	{
+		const char* pos = static_cast<const char*>(frame);
+		uint32_t header;
+		if (bytes < sizeof(header) + sizeof(m_messageType))
+		{
+			m_failed = true;
+			return;
+		}
+
+		memcpy(&header, pos, sizeof(header));
+		if (header != NODE_START)
+		{
+			m_failed = true;
+			return;
+		}
+
+		m_frame = pos;
+		m_frameBytes = bytes;
+		memcpy(&m_messageType, pos + sizeof(header), sizeof(m_messageType));
+		m_pos = pos + sizeof(header) + sizeof(m_messageType);
+		m_end = pos + bytes;
+
+		//Positioned at the start of the root node
+		m_item = Item_NodeStart;
+		m_id = m_messageType;
+	}
+
+	bool FrameReader::next()
+	{
+		if (!m_pos)
+			return false;
+
+		uint32_t length;
+		if (!take(&length, sizeof(length)))
+			return false;
+
+		if (length == NODE_START)
+		{
+			if (!take(&m_id, sizeof(m_id)))
+				return false;
+
+			m_item = Item_NodeStart;
+			m_depth = ++m_level;
+			m_data = nullptr;
+			m_dataBytes = 0;
+		}
+		else if (length == NODE_END)
+		{
+			//End of the root node is the end of the message
+			if (m_level == 0)
+			{
+				m_pos = nullptr;
+				return false;
+			}
+
+			m_item = Item_NodeEnd;
+			m_depth = m_level--;
+			m_data = nullptr;
+			m_dataBytes = 0;
+		}
+		else
+		{
+			if (length < sizeof(m_id) || static_cast<size_t>(m_end - m_pos) < length)
+				return fail();
+
+			memcpy(&m_id, m_pos, sizeof(m_id));
+			m_item = Item_Attribute;
+			m_depth = m_level;
+			m_data = m_pos + sizeof(m_id);
+			m_dataBytes = length - sizeof(m_id);
+			m_pos += length;
+		}
+
+		return true;
+	}
+
+	void FrameReader::skipNode()
+	{
+		if (m_item == Item_NodeEnd)
+			return;
+
+		int level = m_depth;
+		while (next())
+			if (m_item == Item_NodeEnd && m_depth == level)
+				return;
+	}
+
+	bool FrameReader::take(void* dest, size_t bytes)
+	{
+		if (static_cast<size_t>(m_end - m_pos) < bytes)
+			return fail();
+
+		memcpy(dest, m_pos, bytes);
+		m_pos += bytes;
+		return true;
+	}
+
+	bool FrameReader::fail()
+	{
+		m_failed = true;
+		m_pos = nullptr;
+		return false;
+	}
+
+}
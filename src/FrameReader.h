@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+namespace zusi
+{
+
+	/**
+	* @brief Walks through an encoded message without decoding it into a Node
+	*
+	* Nothing is copied or allocated; the reader points into the message, which must
+	* remain valid while it is used. Each call to next() moves to the next sub-node
+	* start, attribute or sub-node end in the order they appear on the wire.
+	*
+	* @code
+	* uint16_t command = 0;
+	* while (reader.next())
+	* {
+	*     if (reader.item() == FrameReader::Item_NodeStart && reader.depth() == 1)
+	*         command = reader.id();
+	*     else if (reader.item() == FrameReader::Item_Attribute && reader.depth() == 1 && command == Cmd_DATA_FTD)
+	*         values[reader.id()] = reader.valueFloat();
+	* }
+	* @endcode
+	*/
+	class FrameReader
+	{
+	public:
+		//! Kinds of item in a message
+		enum Item
+		{
+			Item_NodeStart,
+			Item_Attribute,
+			Item_NodeEnd
+		};
+
+		//! Reader with no message
+		FrameReader();
+
+		/**
+		* @brief Start reading a message
+		* @param frame Message including the message header
+		* @param bytes Size of the message
+		*/
+		FrameReader(const void* frame, size_t bytes);
+
+		//! ID of the message's root node (MsgType), or 0 if there is no valid message
+		uint16_t messageType() const { return m_messageType; }
+
+		//! The whole message as passed to the constructor, e.g. to record it; nullptr if it is not a valid message
+		const char* frame() const { return m_frame; }
+
+		//! Size of the whole message
+		size_t frameBytes() const { return m_frameBytes; }
+
+		/**
+		* @brief Move to the next item
+		* @return False at the end of the root node, or if the message is invalid
+		*/
+		bool next();
+
+		//! Kind of the current item
+		Item item() const { return m_item; }
+
+		//! ID of the current node or attribute
+		uint16_t id() const { return m_id; }
+
+		/**
+		* @brief Nesting level of the current item
+		*
+		* Sub-nodes of the root node (commands) are at level 1. For an attribute this is
+		* the level of the node containing it, the root node being level 0.
+		*/
+		int depth() const { return m_depth; }
+
+		//! Data of the current attribute
+		const char* data() const { return m_data; }
+
+		//! Size of the current attribute's data
+		uint32_t dataBytes() const { return m_dataBytes; }
+
+		//! The current attribute as Single, 0 if it has a different size
+		float valueFloat() const { return value<float>(); }
+
+		//! The current attribute as Word, 0 if it has a different size
+		uint16_t valueUint16() const { return value<uint16_t>(); }
+
+		//! The current attribute as SmallInt, 0 if it has a different size
+		int16_t valueInt16() const { return value<int16_t>(); }
+
+		//! The current attribute as Byte, 0 if it has a different size
+		uint8_t valueUint8() const { return value<uint8_t>(); }
+
+		/**
+		* @brief Skip to the end of the node just started, or of the node containing the current attribute
+		*
+		* next() then continues after that node's end.
+		*/
+		void skipNode();
+
+		//! True if reading stopped at invalid data
+		bool failed() const { return m_failed; }
+
+	private:
+		//! Copy bytes from the message and advance, or fail if the message is too short
+		bool take(void* dest, size_t bytes);
+
+		//! Stop reading at invalid data
+		bool fail();
+
+		template <typename T> T value() const
+		{
+			T result = 0;
+			if (m_dataBytes == sizeof(T))
+				memcpy(&result, m_data, sizeof(T));
+			return result;
+		}
+
+		const char* m_frame;
+		size_t m_frameBytes;
+		const char* m_pos;
+		const char* m_end;
+		uint16_t m_messageType;
+		//! Level of the innermost open node
+		int m_level;
+
+		Item m_item;
+		uint16_t m_id;
+		int m_depth;
+		const char* m_data;
+		uint32_t m_dataBytes;
+		bool m_failed;
+	};
+
+}
@@ -0,0 +1,257 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "History.h"
+#include "Dispatcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace zusi
+{
+
+	HistorySeries::HistorySeries(size_t capacity, unsigned levels, unsigned factor) : m_levels(levels + 1), m_factor(factor), m_latest(0)
+	{
+		if (capacity == 0 || factor < 2)
+			throw std::runtime_error("History error - capacity must be positive and factor at least 2");
+
+		for (Level& level : m_levels)
+		{
+			level.ring.resize(capacity);
+			level.first = 0;
+			level.count = 0;
+			level.partialCount = 0;
+		}
+	}
+
+	void HistorySeries::add(Clock::Duration time, float value)
+	{
+		HistoryPoint sample = { time, time, value, value };
+		m_latest = time;
+		push(0, sample);
+	}
+
+	void HistorySeries::push(unsigned level, const HistoryPoint& bucket)
+	{
+		Level& dest = m_levels[level];
+		if (dest.count < dest.ring.size())
+		{
+			dest.ring[(dest.first + dest.count) % dest.ring.size()] = bucket;
+			++dest.count;
+		}
+		else
+		{
+			dest.ring[dest.first] = bucket;
+			dest.first = (dest.first + 1) % dest.ring.size();
+		}
+
+		if (level + 1 == m_levels.size())
+			return;
+
+		//Summarise into the next level, which takes a bucket once factor have been collected
+		Level& next = m_levels[level + 1];
+		if (next.partialCount == 0)
+		{
+			next.partial = bucket;
+		}
+		else
+		{
+			next.partial.end = bucket.end;
+			next.partial.min = std::min(next.partial.min, bucket.min);
+			next.partial.max = std::max(next.partial.max, bucket.max);
+		}
+
+		if (++next.partialCount == m_factor)
+		{
+			next.partialCount = 0;
+			push(level + 1, next.partial);
+		}
+	}
+
+	size_t HistorySeries::lowerBound(const Level& level, Clock::Duration time)
+	{
+		size_t low = 0, high = level.count;
+		while (low < high)
+		{
+			size_t mid = low + (high - low) / 2;
+			if (level.at(mid).end < time)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		return low;
+	}
+
+	void HistorySeries::query(Clock::Duration begin, Clock::Duration end, size_t points, std::vector<HistoryPoint>& dest) const
+	{
+		dest.clear();
+		if (empty() || points == 0 || end < begin)
+			return;
+
+		//Finest level which reaches back to begin with few enough buckets in the range
+		size_t level = 0, first = 0, last = 0;
+		for (; level < m_levels.size(); ++level)
+		{
+			const Level& candidate = m_levels[level];
+			if (candidate.count == 0)
+				continue;
+
+			first = lowerBound(candidate, begin);
+			last = lowerBound(candidate, end);
+			while (last < candidate.count && candidate.at(last).begin <= end)
+				++last;
+
+			bool covers = candidate.at(0).begin <= begin || candidate.count < candidate.ring.size();
+			if (covers && last - first <= points * m_factor)
+				break;
+		}
+		if (level == m_levels.size())
+		{
+			//Even the coarsest level has too many buckets or does not cover the range - use it anyway
+			for (level = m_levels.size() - 1; m_levels[level].count == 0; --level);
+			const Level& coarsest = m_levels[level];
+			first = lowerBound(coarsest, begin);
+			last = lowerBound(coarsest, end);
+			while (last < coarsest.count && coarsest.at(last).begin <= end)
+				++last;
+			first = std::max(first, last - std::min(last, points * m_factor));
+		}
+
+		//Samples newer than the level's last bucket are still being summarised in the finer levels
+		auto isRecent = [&](const Level& pending) {
+			return pending.partialCount > 0 && pending.partial.end >= begin && pending.partial.begin <= end;
+		};
+		size_t recent_count = 0;
+		for (size_t partial = level; partial >= 1; --partial)
+			if (isRecent(m_levels[partial]))
+				++recent_count;
+
+		const Level& source = m_levels[level];
+		size_t buckets = last - first + recent_count;
+		size_t count = std::min(points, buckets);
+
+		//The partial buckets are kept behind the points in dest, so a reused dest needs no allocation
+		dest.resize(count + recent_count);
+		HistoryPoint* recent = dest.data() + count;
+		for (size_t partial = level; partial >= 1; --partial)
+			if (isRecent(m_levels[partial]))
+				*recent++ = m_levels[partial].partial;
+		recent = dest.data() + count;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t from = i * buckets / count, to = (i + 1) * buckets / count;
+			HistoryPoint& point = dest[i];
+			for (size_t b = from; b < to; ++b)
+			{
+				const HistoryPoint& bucket = b < last - first ? source.at(first + b) : recent[b - (last - first)];
+				if (b == from)
+				{
+					point = bucket;
+				}
+				else
+				{
+					point.end = bucket.end;
+					point.min = std::min(point.min, bucket.min);
+					point.max = std::max(point.max, bucket.max);
+				}
+			}
+		}
+
+		dest.resize(count);
+	}
+
+	History::History(size_t capacity, unsigned levels, unsigned factor) : m_capacity(capacity), m_levels(levels), m_factor(factor)
+	{
+	}
+
+	void History::track(FuehrerstandData id)
+	{
+		if (m_series.size() <= static_cast<size_t>(id))
+			m_series.resize(id + 1);
+
+		if (!m_series[id])
+			m_series[id].reset(new HistorySeries(m_capacity, m_levels, m_factor));
+	}
+
+	const HistorySeries* History::series(FuehrerstandData id) const
+	{
+		if (static_cast<size_t>(id) >= m_series.size())
+			return nullptr;
+
+		return m_series[id].get();
+	}
+
+	void History::add(FuehrerstandData id, Clock::Duration time, float value)
+	{
+		if (static_cast<size_t>(id) < m_series.size() && m_series[id])
+			m_series[id]->add(time, value);
+	}
+
+	void History::add(Clock::Duration time, const Node& msg)
+	{
+		if (msg.getId() != MsgType_Fahrpult)
+			return;
+
+		for (const Node* cmd : msg.nodes)
+		{
+			if (cmd->getId() != Cmd_DATA_FTD)
+				continue;
+
+			for (const Attribute* att : cmd->attributes)
+			{
+				float value;
+				if (att->data_bytes != sizeof(value))
+					continue;
+
+				memcpy(&value, att->data, sizeof(value));
+				add(static_cast<FuehrerstandData>(att->getId()), time, value);
+			}
+		}
+	}
+
+	void History::attach(Dispatcher& dispatcher, Clock& clock)
+	{
+		for (size_t id = 0; id < m_series.size(); ++id)
+		{
+			if (!m_series[id])
+				continue;
+
+			HistorySeries* series = m_series[id].get();
+			dispatcher.onFloat(MsgType_Fahrpult, Cmd_DATA_FTD, static_cast<uint16_t>(id), [series, &clock](float value)
+			{
+				series->add(clock.now(), value);
+			});
+		}
+	}
+
+	void History::query(FuehrerstandData id, Clock::Duration begin, Clock::Duration end, size_t points, std::vector<HistoryPoint>& dest) const
+	{
+		const HistorySeries* found = series(id);
+		if (found)
+			found->query(begin, end, points, dest);
+		else
+			dest.clear();
+	}
+
+}
@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "Clock.h"
+
+#include <memory>
+#include <vector>
+
+namespace zusi
+{
+
+	class Dispatcher;
+
+	//! Range of a variable's samples, reduced to its minimum and maximum
+	struct HistoryPoint
+	{
+		//! Time of the first sample
+		Clock::Duration begin;
+		//! Time of the last sample
+		Clock::Duration end;
+		float min;
+		float max;
+	};
+
+	/**
+	* @brief Fixed-size history of one variable at several resolutions
+	*
+	* The latest samples are kept in a ring buffer. Each further level keeps a ring
+	* of min/max buckets, each summarising factor buckets of the level below, so a
+	* level covers factor times the time span of the one below. The levels are updated
+	* as samples are added, at constant amortised cost.
+	*
+	* A query uses the finest level which covers the requested range with at most
+	* factor buckets per requested point, so it takes time proportional to the
+	* number of points, not to the number of samples in the range.
+	*/
+	class HistorySeries
+	{
+	public:
+		/**
+		* @param capacity Number of samples or buckets kept per level
+		* @param levels Number of min/max levels above the samples
+		* @param factor Number of buckets of the level below in each bucket
+		*/
+		HistorySeries(size_t capacity, unsigned levels, unsigned factor);
+
+		/**
+		* @brief Add a sample
+		* @param time Time of the sample, not earlier than the previous one
+		* @param value Value of the sample
+		*/
+		void add(Clock::Duration time, float value);
+
+		/**
+		* @brief Get the history within a time range reduced to at most points values
+		*
+		* Points are made of whole buckets, so the first and last point may include
+		* samples just outside the range; their begin and end times show this.
+		* @param begin Start of the range
+		* @param end End of the range
+		* @param points Maximum number of points
+		* @param dest Receives the points in time order, replacing its contents. Reusing it avoids allocation.
+		*/
+		void query(Clock::Duration begin, Clock::Duration end, size_t points, std::vector<HistoryPoint>& dest) const;
+
+		//! True if no sample was added yet
+		bool empty() const { return m_levels[0].count == 0; }
+
+		//! Time of the latest sample
+		Clock::Duration latest() const { return m_latest; }
+
+	private:
+		//! Ring of buckets at one resolution
+		struct Level
+		{
+			std::vector<HistoryPoint> ring;
+			//! Position of the oldest bucket
+			size_t first;
+			size_t count;
+			//! Bucket being filled from the level below, not yet in the ring
+			HistoryPoint partial;
+			unsigned partialCount;
+
+			const HistoryPoint& at(size_t i) const { return ring[(first + i) % ring.size()]; }
+		};
+
+		void push(unsigned level, const HistoryPoint& bucket);
+
+		//! Index of the first bucket of a level ending at or after time
+		static size_t lowerBound(const Level& level, Clock::Duration time);
+
+		std::vector<Level> m_levels;
+		unsigned m_factor;
+		Clock::Duration m_latest;
+	};
+
+	/**
+	* @brief Fixed-size histories of Fuehrerstand variables for trend displays
+	*
+	* Keeps a HistorySeries for each tracked variable, fed from DATA_FTD messages.
+	* Memory use only depends on the number of variables and the series parameters.
+	* The class is not synchronised; add and query from one thread, or lock around it.
+	*
+	* @code
+	* History history;
+	* history.track(Fs_Geschwindigkeit);
+	* history.attach(dispatcher, clock);
+	* ...
+	* history.query(Fs_Geschwindigkeit, clock.now() - std::chrono::minutes(10), clock.now(), 500, points);
+	* @endcode
+	*/
+	class History
+	{
+	public:
+		/**
+		* @param capacity Number of samples or buckets kept per level
+		* @param levels Number of min/max levels above the samples
+		* @param factor Number of buckets of the level below in each bucket
+		*
+		* With the defaults, 4096 samples are kept; at 10 updates per second the
+		* coarsest level covers about three days.
+		*/
+		History(size_t capacity = 4096, unsigned levels = 4, unsigned factor = 8);
+
+		//! Start keeping the history of a variable
+		void track(FuehrerstandData id);
+
+		//! History of a variable, nullptr if it is not tracked
+		const HistorySeries* series(FuehrerstandData id) const;
+
+		//! Add a sample of a tracked variable; other variables are ignored
+		void add(FuehrerstandData id, Clock::Duration time, float value);
+
+		//! Add the Single values of tracked variables from a DATA_FTD message
+		void add(Clock::Duration time, const Node& msg);
+
+		/**
+		* @brief Add the values of the variables tracked so far as a dispatcher receives them
+		*
+		* Samples are timed with clock. Both must outlive the dispatcher's use.
+		*/
+		void attach(Dispatcher& dispatcher, Clock& clock);
+
+		//! See HistorySeries::query(); dest is emptied if the variable is not tracked
+		void query(FuehrerstandData id, Clock::Duration begin, Clock::Duration end, size_t points, std::vector<HistoryPoint>& dest) const;
+
+	private:
+		size_t m_capacity;
+		unsigned m_levels;
+		unsigned m_factor;
+
+		//! Indexed by FuehrerstandData, nullptr where not tracked
+		std::vector<std::unique_ptr<HistorySeries>> m_series;
+	};
+
+}
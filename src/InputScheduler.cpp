@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "InputScheduler.h"
+
+#include <algorithm>
+
+namespace zusi
+{
+
+	InputScheduler::Lever::Lever() : pending(false), kommand(Tk_Unbestimmt), aktion(Ta_Default), position(0),
+		sentOnce(false), sentKommand(Tk_Unbestimmt), sentAktion(Ta_Default), sentPosition(0), sentTime(0)
+	{
+	}
+
+	InputScheduler::InputScheduler(ClientConnection& con, Clock& clock, Clock::Duration window) : m_con(con), m_clock(clock), m_window(window),
+		m_sent(0), m_coalesced(0)
+	{
+	}
+
+	bool InputScheduler::input(Tastatur taster, TastaturKommand kommand, TastaturAktion aktion, int16_t position)
+	{
+		Lever& state = lever(taster);
+
+		if (!isAbsolute(aktion))
+		{
+			//Keep the order of this lever's inputs, then let the server's idea of its position take over
+			bool result = true;
+			if (state.pending)
+			{
+				m_pending.erase(std::find(m_pending.begin(), m_pending.end(), taster));
+				result = sendPending(taster, state, m_clock.now());
+			}
+			state.sentOnce = false;
+
+			return send(taster, kommand, aktion, position) && result;
+		}
+
+		if (state.pending)
+			++m_coalesced;
+		else
+			m_pending.push_back(taster);
+
+		state.pending = true;
+		state.kommand = kommand;
+		state.aktion = aktion;
+		state.position = position;
+
+		//Send at once if the window since the last position has passed
+		Clock::Duration now = m_clock.now();
+		if (!state.sentOnce || now - state.sentTime >= m_window)
+		{
+			m_pending.erase(std::find(m_pending.begin(), m_pending.end(), taster));
+			return sendPending(taster, state, now);
+		}
+
+		return true;
+	}
+
+	bool InputScheduler::poll()
+	{
+		if (m_pending.empty())
+			return true;
+
+		Clock::Duration now = m_clock.now();
+		bool result = true;
+		for (size_t i = 0; i < m_pending.size();)
+		{
+			Tastatur taster = m_pending[i];
+			Lever& state = m_levers[taster];
+			if (now - state.sentTime >= m_window)
+			{
+				m_pending.erase(m_pending.begin() + i);
+				result = sendPending(taster, state, now) && result;
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		return result;
+	}
+
+	bool InputScheduler::flush()
+	{
+		Clock::Duration now = m_clock.now();
+		bool result = true;
+		for (Tastatur taster : m_pending)
+			result = sendPending(taster, m_levers[taster], now) && result;
+		m_pending.clear();
+
+		return result;
+	}
+
+	Clock::Duration InputScheduler::nextDue() const
+	{
+		Clock::Duration due = Clock::Duration::max();
+		for (Tastatur taster : m_pending)
+			due = std::min(due, m_levers[taster].sentTime + m_window);
+
+		return due;
+	}
+
+	bool InputScheduler::isAbsolute(TastaturAktion aktion)
+	{
+		return aktion == Ta_Absolut || aktion == Ta_Absolut1000er;
+	}
+
+	InputScheduler::Lever& InputScheduler::lever(Tastatur taster)
+	{
+		if (m_levers.size() <= static_cast<size_t>(taster))
+			m_levers.resize(taster + 1);
+
+		return m_levers[taster];
+	}
+
+	bool InputScheduler::sendPending(Tastatur taster, Lever& lever, Clock::Duration now)
+	{
+		lever.pending = false;
+		if (lever.sentOnce && lever.sentPosition == lever.position && lever.sentAktion == lever.aktion && lever.sentKommand == lever.kommand)
+		{
+			++m_coalesced;
+			return true;
+		}
+
+		lever.sentOnce = true;
+		lever.sentKommand = lever.kommand;
+		lever.sentAktion = lever.aktion;
+		lever.sentPosition = lever.position;
+		lever.sentTime = now;
+
+		return send(taster, lever.kommand, lever.aktion, lever.position);
+	}
+
+	bool InputScheduler::send(Tastatur taster, TastaturKommand kommand, TastaturAktion aktion, int16_t position)
+	{
+		++m_sent;
+		return m_con.sendInput(taster, kommand, aktion, position);
+	}
+
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "Clock.h"
+
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Limits the rate of INPUT commands sent for absolute lever positions
+	*
+	* Absolute positions (Ta_Absolut, Ta_Absolut1000er) are coalesced per Tastatur:
+	* the first one is sent at once, and later ones within the window only replace
+	* a pending position, which is sent once the window has passed since the last
+	* send. A pending position equal to the last one sent is dropped.
+	*
+	* All other inputs, such as Down/Up for Pfeife or Sifa, are sent immediately and
+	* in order. A pending position of the same Tastatur is sent before them, so the
+	* server sees that lever's inputs in the order they were made.
+	*
+	* The scheduler has no thread of its own: call poll() regularly, e.g. from the loop
+	* reading the hardware, or sleep until nextDue(). Like the connection, it must only
+	* be used by one thread at a time.
+	*
+	* @code
+	* InputScheduler inputs(con, clock, std::chrono::milliseconds(50));
+	* while (running)
+	* {
+	*     inputs.input(Tt_Fahrschalter, Tk_Unbestimmt, Ta_Absolut, readLever());
+	*     inputs.poll();
+	*     clock.sleepFor(std::chrono::milliseconds(1));
+	* }
+	* inputs.flush();
+	* @endcode
+	*/
+	class InputScheduler
+	{
+	public:
+		/**
+		* @param con Connection to send with - class does not take ownership of it
+		* @param clock Time source for the window - class does not take ownership of it
+		* @param window Minimum time between two absolute positions sent for one Tastatur
+		*/
+		InputScheduler(ClientConnection& con, Clock& clock, Clock::Duration window);
+
+		/**
+		* @brief Send an input, or hold it back if it is an absolute position within the window
+		* @return False if sending failed
+		*/
+		bool input(Tastatur taster, TastaturKommand kommand, TastaturAktion aktion, int16_t position);
+
+		/**
+		* @brief Send the pending positions whose window has passed
+		* @return False if sending failed
+		*/
+		bool poll();
+
+		//! Send all pending positions now, e.g. before disconnecting
+		bool flush();
+
+		//! Clock time at which poll() next has something to send, Clock::Duration::max() if nothing is pending
+		Clock::Duration nextDue() const;
+
+		//! Number of INPUT commands sent
+		uint64_t sent() const { return m_sent; }
+
+		//! Number of absolute positions replaced by a newer one or dropped as unchanged
+		uint64_t coalesced() const { return m_coalesced; }
+
+	private:
+		//! Absolute position state of one Tastatur
+		struct Lever
+		{
+			Lever();
+
+			bool pending;
+			TastaturKommand kommand;
+			TastaturAktion aktion;
+			int16_t position;
+
+			//! Last absolute input sent, valid if sentOnce
+			bool sentOnce;
+			TastaturKommand sentKommand;
+			TastaturAktion sentAktion;
+			int16_t sentPosition;
+			Clock::Duration sentTime;
+		};
+
+		static bool isAbsolute(TastaturAktion aktion);
+
+		Lever& lever(Tastatur taster);
+
+		//! Send the pending position of a lever, unless it is unchanged
+		bool sendPending(Tastatur taster, Lever& lever, Clock::Duration now);
+
+		bool send(Tastatur taster, TastaturKommand kommand, TastaturAktion aktion, int16_t position);
+
+		ClientConnection& m_con;
+		Clock& m_clock;
+		Clock::Duration m_window;
+
+		//! Indexed by Tastatur
+		std::vector<Lever> m_levers;
+		//! Tastatur of each lever with a pending position
+		std::vector<Tastatur> m_pending;
+
+		uint64_t m_sent;
+		uint64_t m_coalesced;
+	};
+
+}
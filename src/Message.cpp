@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "Message.h"
+#include "BufferSocket.h"
+
+namespace zusi
+{
+
+	Message::Message()
+	{
+	}
+
+	Message::Message(Node&& root)
+	{
+		//The tree cannot change any more, so its index stays valid
+		std::shared_ptr<Node> shared = std::make_shared<Node>(std::move(root));
+		shared->buildIndex();
+		m_root = shared;
+	}
+
+	Message Message::decode(const void* frame, size_t bytes)
+	{
+		if (bytes < sizeof(uint32_t) + sizeof(uint16_t))
+			throw std::runtime_error("Protocol error - message too short");
+
+		//Skip the message header, Node::read() expects the ID next
+		BufferSocket sock(static_cast<const char*>(frame) + sizeof(uint32_t), bytes - sizeof(uint32_t));
+		Node root;
+		if (!root.read(sock))
+			throw std::runtime_error("Protocol error - invalid message");
+
+		return Message(std::move(root));
+	}
+
+	uint16_t Message::type() const
+	{
+		return m_root ? m_root->getId() : 0;
+	}
+
+	uint16_t Message::command() const
+	{
+		if (!m_root || m_root->nodes.empty())
+			return 0;
+
+		return m_root->nodes[0]->getId();
+	}
+
+}
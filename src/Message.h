@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <memory>
+
+namespace zusi
+{
+
+	/**
+	* @brief Shared, read-only handle to a decoded message
+	*
+	* Copying a Message copies the handle, not the Node tree, so one received message
+	* can be passed to several consumers (logging, state, display) on different threads
+	* at once. The tree is deleted when the last handle to it is destroyed or reset.
+	*
+	* Consumers must not modify the tree, including the data of its attributes. A
+	* handle itself must not be assigned to while another thread uses the same handle;
+	* give each thread its own copy.
+	*
+	* @code
+	* Node received;
+	* connection.receiveMessage(received);
+	* Message msg(std::move(received));
+	* logger.post(msg);
+	* cache.post(msg);
+	* @endcode
+	*/
+	class Message
+	{
+	public:
+		//! Handle to no message
+		Message();
+
+		/**
+		* @brief Take over a decoded message
+		*
+		* The tree is indexed (Node::buildIndex()), so lookups by ID do not scan.
+		* @param root The message's root node, left empty - its sub-nodes and attributes are moved, not copied
+		*/
+		explicit Message(Node&& root);
+
+		/**
+		* @brief Decode an encoded message
+		* @param frame Message including the message header, e.g. from FrameBuffer or CaptureReader
+		* @param bytes Size of the message
+		*/
+		static Message decode(const void* frame, size_t bytes);
+
+		//! True if the handle refers to no message
+		bool empty() const { return !m_root; }
+
+		//! Root node of the message; the handle must not be empty
+		const Node& root() const { return *m_root; }
+
+		const Node& operator*() const { return *m_root; }
+		const Node* operator->() const { return m_root.get(); }
+
+		//! ID of the root node (MsgType), or 0 for an empty handle
+		uint16_t type() const;
+
+		//! ID of the first sub-node (command), or 0 if there is none
+		uint16_t command() const;
+
+		//! Number of handles sharing the message, 0 for an empty handle
+		long holders() const { return m_root.use_count(); }
+
+		//! Release this handle's share of the message
+		void reset() { m_root.reset(); }
+
+	private:
+		std::shared_ptr<const Node> m_root;
+	};
+
+}
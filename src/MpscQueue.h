@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <utility>
+
+namespace zusi
+{
+
+	/**
+	* @brief Unbounded lock-free queue for any number of producer threads and one consumer thread
+	*
+	* Each element is held in its own node. push() links a node with a single atomic
+	* exchange, so producers never wait for each other or for the consumer. pop() and
+	* empty() must only be called from the consumer thread.
+	*/
+	template <typename T>
+	class MpscQueue
+	{
+	public:
+		MpscQueue() : m_head(new Node()), m_tail(m_head.load())
+		{
+		}
+
+		//! Destroys any remaining elements
+		~MpscQueue()
+		{
+			T discard;
+			while (pop(discard))
+				;
+			delete m_tail;
+		}
+
+		//! Append an element. Any thread.
+		void push(T&& value)
+		{
+			Node* node = new Node(std::move(value));
+			Node* previous = m_head.exchange(node);
+			previous->next.store(node, std::memory_order_release);
+		}
+
+		//! Append a copy of an element. Any thread.
+		void push(const T& value)
+		{
+			T copy(value);
+			push(std::move(copy));
+		}
+
+		/**
+		* @brief Remove the oldest element. Consumer thread only.
+		* @param dest Receives the element
+		* @return False if the queue is empty
+		*/
+		bool pop(T& dest)
+		{
+			Node* tail = m_tail;
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (!next)
+			{
+				if (empty())
+					return false;
+
+				//A producer has claimed its place but not linked the node yet
+				do
+				{
+					std::this_thread::yield();
+					next = tail->next.load(std::memory_order_acquire);
+				} while (!next);
+			}
+
+			//next becomes the new dummy node
+			dest = std::move(next->value);
+			next->value = T();
+			m_tail = next;
+			delete tail;
+			return true;
+		}
+
+		//! True if nothing has been pushed since the last element was popped. Consumer thread only.
+		bool empty() const
+		{
+			return m_head.load() == m_tail;
+		}
+
+	private:
+		MpscQueue(const MpscQueue& other);
+		MpscQueue& operator=(const MpscQueue& other);
+
+		struct Node
+		{
+			Node() : next(nullptr)
+			{
+			}
+
+			explicit Node(T&& v) : next(nullptr), value(std::move(v))
+			{
+			}
+
+			std::atomic<Node*> next;
+			T value;
+		};
+
+		//Padding keeps the two sides on separate cache lines without requiring over-aligned allocation
+		static const size_t CACHE_LINE = 64;
+
+		//Producer side: most recently pushed node
+		std::atomic<Node*> m_head;
+		char m_pad0[CACHE_LINE];
+
+		//Consumer side: dummy node in front of the oldest element
+		Node* m_tail;
+		char m_pad1[CACHE_LINE];
+	};
+
+}
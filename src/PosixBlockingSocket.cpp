@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PosixBlockingSocket.h"
+
+#include <cerrno>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace zusi
+{
+
+	PosixBlockingSocket::PosixBlockingSocket(const char* ip_address, int port)
+	{
+		// Create our socket
+		m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (m_socket < 0)
+			throw std::runtime_error("Socket error - Socket creation Failed!");
+
+		// Setup our socket address structure
+		sockaddr_in sock_addr = {};
+		sock_addr.sin_port = htons(port);
+		sock_addr.sin_family = AF_INET;
+		inet_pton(AF_INET, ip_address, &(sock_addr.sin_addr));
+
+		// Attempt to connect to server
+		if (connect(m_socket, reinterpret_cast<sockaddr*>(&sock_addr), sizeof(sock_addr)) != 0)
+		{
+			close(m_socket);
+			throw std::runtime_error("Failed to establish connection with server");
+		}
+	}
+
+	PosixBlockingSocket::PosixBlockingSocket(int socket) : m_socket(socket)
+	{
+	}
+
+	PosixBlockingSocket::~PosixBlockingSocket()
+	{
+		shutdown(m_socket, SHUT_WR);
+		close(m_socket);
+	}
+
+	int PosixBlockingSocket::ReadBytes(void* dest, int bytes)
+	{
+		return static_cast<int>(recv(m_socket, dest, bytes, MSG_WAITALL));
+	}
+
+	int PosixBlockingSocket::WriteBytes(const void* src, int bytes)
+	{
+		return static_cast<int>(send(m_socket, src, bytes, MSG_NOSIGNAL));
+	}
+
+	bool PosixBlockingSocket::DataToRead()
+	{
+		int bytes_available;
+		if (ioctl(m_socket, FIONREAD, &bytes_available) != 0)
+			return false;
+		return bytes_available > 0;
+	}
+
+	int PosixBlockingSocket::BytesAvailable()
+	{
+		int bytes_available;
+		if (ioctl(m_socket, FIONREAD, &bytes_available) != 0)
+			return -1;
+		if (bytes_available > 0)
+			return bytes_available;
+
+		//Nothing buffered - distinguish between no data yet and end of stream
+		char peek;
+		ssize_t result = recv(m_socket, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+		if (result > 0)
+			return 1;
+		if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return 0;
+		return -1;
+	}
+
+	bool PosixBlockingSocket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		pollfd pfd = {};
+		pfd.fd = m_socket;
+		pfd.events = POLLIN;
+
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000);
+		ts.tv_nsec = static_cast<long>(timeout.count() % 1000000) * 1000;
+
+		//POLLHUP and POLLERR count as readable, BytesAvailable() then reports the end of the stream
+		return ppoll(&pfd, 1, &ts, nullptr) > 0;
+	}
+}
@@ -0,0 +1,73 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+namespace zusi
+{
+
+	/**
+	* @brief Socket implemented using the POSIX/BSD socket functions in blocking mode.
+	*
+	* Counterpart of WinsockBlockingSocket for Linux.
+	*/
+	class PosixBlockingSocket :
+		public zusi::Socket
+	{
+	public:
+		/**
+		* @brief Construct a new socket and initiate a TCP connection
+		* @param ip_address Null-terminated string of IP Address to connect to
+		* @param port Port to connection to, usually 1436.
+		* @throws std::runtime_error system error when creating socket
+		*/
+		PosixBlockingSocket(const char* ip_address, int port);
+
+		/**
+		* @brief Construct a new socket using an existing socket handle
+		*
+		* The class will handle clean-up of the socket.
+		*
+		* @param socket File descriptor of a connected socket
+		*/
+		PosixBlockingSocket(int socket);
+
+		virtual ~PosixBlockingSocket();
+
+		virtual int ReadBytes(void* dest, int bytes);
+		virtual int WriteBytes(const void* src, int bytes);
+		virtual bool DataToRead();
+		virtual int BytesAvailable();
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
+
+		//! Underlying file descriptor
+		int handle() const { return m_socket; }
+
+	private:
+
+		PosixBlockingSocket(const PosixBlockingSocket& other);
+
+		int m_socket;
+	};
+
+}
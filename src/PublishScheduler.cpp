@@ -0,0 +1,189 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "PublishScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace zusi
+{
+
+	PublishScheduler::Variable::Variable() : subscribed(false), period(1), scheduled(false), value(0.0f), due(0),
+		sentOnce(false), sentValue(0.0f), sentTick(0)
+	{
+	}
+
+	PublishScheduler::PublishScheduler(ServerConnection& con, Clock& clock, Clock::Duration tick) : m_con(con), m_clock(clock), m_tick(tick),
+		m_wheel(WHEEL_SLOTS), m_scheduled(0), m_nextTick(0), m_messages(0), m_values(0), m_coalesced(0)
+	{
+		if (tick <= Clock::Duration::zero())
+			throw std::runtime_error("Scheduler error - tick must be positive");
+
+		//Look up the client's subscription once, instead of for every value
+		for (FuehrerstandData id : con.getFuehrerstandData())
+			variable(id).subscribed = true;
+
+		m_nextTick = static_cast<uint64_t>(m_clock.now() / m_tick);
+	}
+
+	void PublishScheduler::setRate(FuehrerstandData id, double hz)
+	{
+		if (!(hz > 0.0))
+			throw std::runtime_error("Scheduler error - rate must be positive");
+
+		std::chrono::duration<double> period(1.0 / hz);
+		setPeriod(id, std::chrono::duration_cast<Clock::Duration>(period));
+	}
+
+	void PublishScheduler::setPeriod(FuehrerstandData id, Clock::Duration period)
+	{
+		double ticks = std::round(static_cast<double>(period.count()) / static_cast<double>(m_tick.count()));
+		variable(id).period = static_cast<uint64_t>(std::max(ticks, 1.0));
+	}
+
+	void PublishScheduler::post(FuehrerstandData id, float value)
+	{
+		Variable& var = variable(id);
+		if (!var.subscribed)
+			return;
+
+		if (var.scheduled)
+		{
+			var.value = value;
+			++m_coalesced;
+			return;
+		}
+
+		if (var.sentOnce && var.sentValue == value)
+		{
+			++m_coalesced;
+			return;
+		}
+
+		var.value = value;
+		var.due = var.sentOnce ? std::max(m_nextTick, var.sentTick + var.period) : m_nextTick;
+		var.scheduled = true;
+		m_wheel[var.due % WHEEL_SLOTS].push_back(static_cast<uint16_t>(id));
+		++m_scheduled;
+	}
+
+	bool PublishScheduler::poll()
+	{
+		uint64_t now = static_cast<uint64_t>(m_clock.now() / m_tick);
+		if (now < m_nextTick)
+			return true;
+
+		m_writer.clear();
+		if (m_scheduled > 0)
+		{
+			//After a long pause every slot is visited once, rather than every tick missed
+			uint64_t last_slot = std::min(now, m_nextTick + WHEEL_SLOTS - 1);
+			collect(m_nextTick, last_slot, now, now);
+		}
+		m_nextTick = now + 1;
+
+		if (m_writer.size() == 0)
+			return true;
+
+		m_writer.endNode();
+		m_writer.endNode();
+		++m_messages;
+		return m_con.sendMessage(m_writer);
+	}
+
+	bool PublishScheduler::flush()
+	{
+		if (m_scheduled == 0)
+			return true;
+
+		uint64_t now = static_cast<uint64_t>(m_clock.now() / m_tick);
+
+		m_writer.clear();
+		collect(m_nextTick, m_nextTick + WHEEL_SLOTS - 1, UINT64_MAX, now);
+
+		m_writer.endNode();
+		m_writer.endNode();
+		++m_messages;
+		return m_con.sendMessage(m_writer);
+	}
+
+	Clock::Duration PublishScheduler::nextDue() const
+	{
+		if (m_scheduled == 0)
+			return Clock::Duration::max();
+
+		//An entry in the slot of tick is due at tick or a whole number of turns later
+		uint64_t due = UINT64_MAX;
+		for (uint64_t tick = m_nextTick; tick < m_nextTick + WHEEL_SLOTS && due > tick; ++tick)
+			for (uint16_t id : m_wheel[tick % WHEEL_SLOTS])
+				due = std::min(due, m_variables[id].due);
+
+		return m_tick * static_cast<Clock::Duration::rep>(due);
+	}
+
+	PublishScheduler::Variable& PublishScheduler::variable(FuehrerstandData id)
+	{
+		size_t index = static_cast<size_t>(id);
+		if (index >= m_variables.size())
+			m_variables.resize(index + 1);
+		return m_variables[index];
+	}
+
+	void PublishScheduler::collect(uint64_t first, uint64_t last, uint64_t due_tick, uint64_t sent_tick)
+	{
+		for (uint64_t tick = first; tick <= last; ++tick)
+		{
+			std::vector<uint16_t>& slot = m_wheel[tick % WHEEL_SLOTS];
+
+			size_t kept = 0;
+			for (uint16_t id : slot)
+			{
+				Variable& var = m_variables[id];
+				if (var.due > due_tick)
+				{
+					//Due on a later turn of the wheel
+					slot[kept++] = id;
+					continue;
+				}
+
+				if (m_writer.size() == 0)
+				{
+					m_writer.beginNode(MsgType_Fahrpult);
+					m_writer.beginNode(Cmd_DATA_FTD);
+				}
+				m_writer.attrFloat(id, var.value);
+
+				var.scheduled = false;
+				var.sentOnce = true;
+				var.sentValue = var.value;
+				var.sentTick = sent_tick;
+				--m_scheduled;
+				++m_values;
+			}
+			slot.resize(kept);
+		}
+	}
+
+}
@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "Clock.h"
+
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Sends Fuehrerstand values to a client at a rate chosen per variable
+	*
+	* Producers post values whenever they like. A posted value is sent once the
+	* variable's period has passed since it was last sent; a newer value posted
+	* before then replaces it, and a value equal to the one last sent is dropped.
+	*
+	* Due variables are kept in a timer wheel with one slot per tick. All variables
+	* due in the ticks handled by one poll() are merged into a single DATA_FTD
+	* message, so the number of messages depends on the tick and the fastest rate,
+	* not on the number of variables. Variables without a rate are sent on the next tick.
+	*
+	* Only Single values can be scheduled; send nodes such as Fs_Sifa with
+	* ServerConnection::sendData(). Create the scheduler after ServerConnection::accept(),
+	* as variables the client did not request are ignored. Like the connection, it must
+	* only be used by one thread at a time.
+	*
+	* @code
+	* PublishScheduler publish(con, clock, std::chrono::milliseconds(1));
+	* publish.setRate(Fs_Geschwindigkeit, 60.0);
+	* publish.setRate(Fs_UhrzeitSekunde, 1.0);
+	* Clock::Duration next_production_tick = clock.now();
+	* while (running)
+	* {
+	*     publish.post(Fs_Geschwindigkeit, simulatedSpeed());
+	*     publish.poll();
+	*
+	*     //nextDue() is Clock::Duration::max() once everything is sent
+	*     next_production_tick += std::chrono::milliseconds(10);
+	*     clock.sleepUntil(std::min(publish.nextDue(), next_production_tick));
+	* }
+	* @endcode
+	*/
+	class PublishScheduler
+	{
+	public:
+		/**
+		* @param con Connection to send with - class does not take ownership of it
+		* @param clock Time source - class does not take ownership of it
+		* @param tick Resolution of the schedule; periods are rounded to whole ticks
+		* @throws std::runtime_error if tick is not positive
+		*/
+		PublishScheduler(ServerConnection& con, Clock& clock, Clock::Duration tick);
+
+		/**
+		* @brief Set the highest rate at which a variable is sent
+		*
+		* Takes effect after the variable is next sent.
+		* @throws std::runtime_error if hz is not positive
+		*/
+		void setRate(FuehrerstandData id, double hz);
+
+		//! Set the shortest time between two values sent for a variable
+		void setPeriod(FuehrerstandData id, Clock::Duration period);
+
+		//! Post the latest value of a variable, to be sent when it is due
+		void post(FuehrerstandData id, float value);
+
+		/**
+		* @brief Send the variables which are due in one DATA_FTD message
+		* @return False if sending failed
+		*/
+		bool poll();
+
+		//! Send all posted values now, e.g. before disconnecting
+		bool flush();
+
+		//! Clock time at which poll() next has something to send, Clock::Duration::max() if nothing is posted
+		Clock::Duration nextDue() const;
+
+		//! Number of DATA_FTD messages sent
+		uint64_t messages() const { return m_messages; }
+
+		//! Number of values sent
+		uint64_t values() const { return m_values; }
+
+		//! Number of posted values replaced by a newer one or dropped as unchanged
+		uint64_t coalesced() const { return m_coalesced; }
+
+	private:
+		//! Number of slots in the wheel, a power of two
+		static const size_t WHEEL_SLOTS = 256;
+
+		//! Schedule of one variable
+		struct Variable
+		{
+			Variable();
+
+			bool subscribed;
+			//! Minimum ticks between two values sent
+			uint64_t period;
+
+			//! Posted value waiting in the wheel
+			bool scheduled;
+			float value;
+			//! Tick at which value is sent, valid if scheduled
+			uint64_t due;
+
+			bool sentOnce;
+			float sentValue;
+			uint64_t sentTick;
+		};
+
+		PublishScheduler(const PublishScheduler& other);
+
+		Variable& variable(FuehrerstandData id);
+
+		/**
+		* @brief Append the variables due at or before due_tick to m_writer and take them out of the wheel
+		* @param first First tick whose slot is visited
+		* @param last Last tick whose slot is visited
+		* @param due_tick Latest due tick to send
+		* @param sent_tick Tick recorded as the time the values were sent
+		*/
+		void collect(uint64_t first, uint64_t last, uint64_t due_tick, uint64_t sent_tick);
+
+		ServerConnection& m_con;
+		Clock& m_clock;
+		Clock::Duration m_tick;
+
+		//! Indexed by FuehrerstandData
+		std::vector<Variable> m_variables;
+		//! IDs of the scheduled variables, by due tick modulo WHEEL_SLOTS
+		std::vector<std::vector<uint16_t>> m_wheel;
+		size_t m_scheduled;
+		//! First tick not handled by poll() yet
+		uint64_t m_nextTick;
+
+		FrameWriter m_writer;
+
+		uint64_t m_messages;
+		uint64_t m_values;
+		uint64_t m_coalesced;
+	};
+
+}
@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "QueuedSocket.h"
+
+namespace zusi
+{
+
+	QueuedSocket::QueuedSocket(Socket* socket, size_t max_bytes, SendQueue::Policy policy) : m_socket(socket), m_queue(max_bytes, policy),
+		m_stopping(false), m_failed(false)
+	{
+		m_writer = std::thread(&QueuedSocket::writerLoop, this);
+	}
+
+	QueuedSocket::~QueuedSocket()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_ready.notify_one();
+		m_writer.join();
+	}
+
+	int QueuedSocket::ReadBytes(void* dest, int bytes)
+	{
+		return m_socket->ReadBytes(dest, bytes);
+	}
+
+	int QueuedSocket::WriteBytes(const void* src, int bytes)
+	{
+		const char* src_chars = static_cast<const char*>(src);
+		m_message.insert(m_message.end(), src_chars, src_chars + bytes);
+		return bytes;
+	}
+
+	bool QueuedSocket::DataToRead()
+	{
+		return m_socket->DataToRead();
+	}
+
+	int QueuedSocket::BytesAvailable()
+	{
+		return m_socket->BytesAvailable();
+	}
+
+	bool QueuedSocket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		return m_socket->WaitReadable(timeout);
+	}
+
+	bool QueuedSocket::Flush()
+	{
+		bool queued;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_failed)
+			{
+				m_message.clear();
+				return false;
+			}
+			queued = m_queue.push(m_message.data(), m_message.size());
+		}
+
+		m_message.clear();
+		m_ready.notify_one();
+		return queued;
+	}
+
+	size_t QueuedSocket::depthBytes()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_queue.depthBytes();
+	}
+
+	uint64_t QueuedSocket::droppedMessages()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_queue.droppedMessages();
+	}
+
+	uint64_t QueuedSocket::coalescedValues()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_queue.coalescedValues();
+	}
+
+	void QueuedSocket::writerLoop()
+	{
+		std::vector<char> chunk;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_ready.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+			if (m_stopping)
+				return;
+
+			//Only the front message is copied. SendQueue never drops or merges it, so consume() stays valid.
+			SendQueue::Buffer front;
+			m_queue.peek(&front, 1);
+			chunk.assign(front.data, front.data + front.bytes);
+
+			lock.unlock();
+			int written = m_socket->WriteBytes(chunk.data(), static_cast<int>(chunk.size()));
+			bool flushed = written > 0 && m_socket->Flush();
+			lock.lock();
+
+			if (!flushed)
+			{
+				m_failed = true;
+				return;
+			}
+
+			m_queue.consume(written);
+		}
+	}
+
+}
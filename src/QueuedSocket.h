@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "SendQueue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace zusi
+{
+
+	/**
+	* @brief Socket which sends through a bounded SendQueue on its own thread
+	*
+	* Wraps a blocking socket so that sending a message never waits for the peer.
+	* Each message is queued when Flush() is called and written to the wrapped
+	* socket by a writer thread. If the peer stops reading, the queue's policy
+	* decides whether messages are merged, dropped, or the connection given up.
+	*
+	* Reads are passed straight through. Only one thread at a time may write a
+	* message (WriteBytes() followed by Flush()).
+	*/
+	class QueuedSocket :
+		public zusi::Socket
+	{
+	public:
+		/**
+		* @brief Start the writer thread
+		* @param socket The socket to send with - class does not take ownership of it
+		* @param max_bytes Size limit for queued data
+		* @param policy What to do when the limit is reached
+		*/
+		QueuedSocket(Socket* socket, size_t max_bytes, SendQueue::Policy policy);
+
+		/**
+		* @brief Stop the writer thread, discarding unsent data
+		*
+		* Waits for a write in progress. If the peer may have stopped reading,
+		* shut down the connection first.
+		*/
+		virtual ~QueuedSocket();
+
+		virtual int ReadBytes(void* dest, int bytes);
+		virtual int WriteBytes(const void* src, int bytes);
+		virtual bool DataToRead();
+		virtual int BytesAvailable();
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
+
+		/**
+		* @brief Queue the message written since the last call
+		* @return False if the message was rejected under SendQueue::Policy_Disconnect, or a write has failed
+		*/
+		virtual bool Flush();
+
+		//! Number of bytes waiting to be sent
+		size_t depthBytes();
+
+		//! Number of messages dropped to make room
+		uint64_t droppedMessages();
+
+		//! Number of values removed because a newer value was queued
+		uint64_t coalescedValues();
+
+	private:
+		QueuedSocket(const QueuedSocket& other);
+
+		void writerLoop();
+
+		Socket* m_socket;
+		std::vector<char> m_message;
+
+		std::mutex m_mutex;
+		std::condition_variable m_ready;
+		SendQueue m_queue;
+		bool m_stopping;
+		bool m_failed;
+
+		std::thread m_writer;
+	};
+
+}
@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "SendQueue.h"
+#include "BufferSocket.h"
+
+#include <map>
+#include <memory>
+
+namespace zusi
+{
+	static const size_t HEADER_BYTES = sizeof(uint32_t);
+
+	//! Decode a message which holds nothing but a DATA_FTD command, otherwise return nullptr
+	static std::unique_ptr<Node> decodeFtd(const std::vector<char>& frame)
+	{
+		if (frame.size() <= HEADER_BYTES)
+			return nullptr;
+
+		BufferSocket sock(frame.data() + HEADER_BYTES, frame.size() - HEADER_BYTES);
+		std::unique_ptr<Node> msg(new Node());
+		if (!msg->read(sock) || sock.DataToRead())
+			return nullptr;
+
+		if (msg->getId() != MsgType_Fahrpult || !msg->attributes.empty() || msg->nodes.size() != 1 || msg->nodes[0]->getId() != Cmd_DATA_FTD)
+			return nullptr;
+
+		return msg;
+	}
+
+	SendQueue::SendQueue(size_t max_bytes, Policy policy) : m_frontSent(0), m_bytes(0), m_maxBytes(max_bytes), m_policy(policy),
+		m_dropped(0), m_coalesced(0), m_overflowed(false)
+	{
+	}
+
+	bool SendQueue::push(const void* data, size_t bytes)
+	{
+		if (m_bytes + bytes > m_maxBytes && m_policy == Policy_Disconnect)
+		{
+			m_overflowed = true;
+			return false;
+		}
+
+		const char* chars = static_cast<const char*>(data);
+		m_frames.emplace_back(chars, chars + bytes);
+		m_bytes += bytes;
+
+		if (m_bytes > m_maxBytes && m_policy == Policy_Coalesce)
+			coalesce();
+		if (m_bytes > m_maxBytes)
+			dropOldest();
+
+		return true;
+	}
+
+	size_t SendQueue::peek(Buffer* dest, size_t max) const
+	{
+		size_t count = 0;
+		for (auto it = m_frames.begin(); it != m_frames.end() && count < max; ++it, ++count)
+		{
+			size_t offset = count == 0 ? m_frontSent : 0;
+			dest[count].data = it->data() + offset;
+			dest[count].bytes = it->size() - offset;
+		}
+		return count;
+	}
+
+	void SendQueue::consume(size_t bytes)
+	{
+		m_bytes -= bytes;
+		while (bytes > 0)
+		{
+			size_t remaining = m_frames.front().size() - m_frontSent;
+			if (bytes < remaining)
+			{
+				m_frontSent += bytes;
+				return;
+			}
+
+			bytes -= remaining;
+			m_frames.pop_front();
+			m_frontSent = 0;
+		}
+	}
+
+	void SendQueue::coalesce()
+	{
+		//Latest value of each variable, in order of first appearance
+		Node merged_cmd(Cmd_DATA_FTD);
+		std::map<uint16_t, size_t> attribute_index;
+		std::map<uint16_t, size_t> node_index;
+
+		size_t last_merged = 0;
+		size_t merged_frames = 0;
+		std::vector<bool> merged(m_frames.size(), false);
+
+		for (size_t i = 1; i < m_frames.size(); ++i)
+		{
+			std::unique_ptr<Node> msg = decodeFtd(m_frames[i]);
+			if (!msg)
+				continue;
+
+			Node& cmd = *msg->nodes[0];
+			for (Attribute* att : cmd.attributes)
+			{
+				auto found = attribute_index.find(att->getId());
+				if (found == attribute_index.end())
+				{
+					attribute_index[att->getId()] = merged_cmd.attributes.size();
+					merged_cmd.attributes.push_back(att);
+				}
+				else
+				{
+					delete merged_cmd.attributes[found->second];
+					merged_cmd.attributes[found->second] = att;
+					++m_coalesced;
+				}
+			}
+			for (Node* node : cmd.nodes)
+			{
+				auto found = node_index.find(node->getId());
+				if (found == node_index.end())
+				{
+					node_index[node->getId()] = merged_cmd.nodes.size();
+					merged_cmd.nodes.push_back(node);
+				}
+				else
+				{
+					delete merged_cmd.nodes[found->second];
+					merged_cmd.nodes[found->second] = node;
+					++m_coalesced;
+				}
+			}
+
+			//Ownership has moved to merged_cmd
+			cmd.attributes.clear();
+			cmd.nodes.clear();
+
+			merged[i] = true;
+			last_merged = i;
+			++merged_frames;
+		}
+
+		if (merged_frames < 2)
+			return;
+
+		//The merged message takes the place of the newest one, so no value is sent earlier than it would have been
+		Node message(MsgType_Fahrpult);
+		message.nodes.push_back(new Node(Cmd_DATA_FTD));
+		std::swap(message.nodes[0]->attributes, merged_cmd.attributes);
+		std::swap(message.nodes[0]->nodes, merged_cmd.nodes);
+
+		BufferSocket encoded;
+		message.write(encoded);
+
+		std::deque<std::vector<char>> frames;
+		size_t bytes = m_frames.front().size() - m_frontSent;
+		frames.push_back(std::move(m_frames.front()));
+		for (size_t i = 1; i < m_frames.size(); ++i)
+		{
+			if (i == last_merged)
+			{
+				frames.push_back(encoded.output());
+				bytes += encoded.output().size();
+			}
+			else if (!merged[i])
+			{
+				bytes += m_frames[i].size();
+				frames.push_back(std::move(m_frames[i]));
+			}
+		}
+
+		m_frames.swap(frames);
+		m_bytes = bytes;
+	}
+
+	void SendQueue::dropOldest()
+	{
+		while (m_bytes > m_maxBytes && m_frames.size() > 2)
+		{
+			//Keep the front message, which may be partly sent, and the newest one
+			m_bytes -= m_frames[1].size();
+			m_frames.erase(m_frames.begin() + 1);
+			++m_dropped;
+		}
+	}
+
+}
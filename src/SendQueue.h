@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <cstddef>
+#include <deque>
+
+namespace zusi
+{
+
+	/**
+	* @brief Bounded queue of encoded messages waiting to be sent to one client
+	*
+	* When a new message would take the queue over its size limit, the policy
+	* decides what happens:
+	* - Policy_Coalesce merges all queued DATA_FTD messages into one which holds only
+	*   the latest value of each variable. If that is not enough, the oldest messages
+	*   are dropped.
+	* - Policy_DropOldest drops the oldest messages until the new one fits.
+	* - Policy_Disconnect rejects the message; the client should be disconnected.
+	*
+	* The message at the front may already be partly sent, so it is never dropped or merged.
+	* A message larger than the limit is still accepted once nothing else can be dropped.
+	*/
+	class SendQueue
+	{
+	public:
+		//! What to do when the queue is full
+		enum Policy
+		{
+			Policy_Coalesce,
+			Policy_DropOldest,
+			Policy_Disconnect
+		};
+
+		//! A piece of queued data
+		struct Buffer
+		{
+			const char* data;
+			size_t bytes;
+		};
+
+		/**
+		* @brief Create an empty queue
+		* @param max_bytes Size limit for queued data
+		* @param policy What to do when the limit is reached
+		*/
+		SendQueue(size_t max_bytes, Policy policy);
+
+		/**
+		* @brief Queue one complete encoded message
+		* @param data Message including the message header
+		* @param bytes Size of the message
+		* @return False if the queue is full and the policy is Policy_Disconnect
+		*/
+		bool push(const void* data, size_t bytes);
+
+		/**
+		* @brief Get the unsent data in order, for a vectored write
+		* @param dest Array which receives the pieces
+		* @param max Size of dest
+		* @return Number of pieces written to dest
+		*/
+		size_t peek(Buffer* dest, size_t max) const;
+
+		//! Remove sent bytes from the front of the queue
+		void consume(size_t bytes);
+
+		//! True if there is no unsent data
+		bool empty() const { return m_frames.empty(); }
+
+		//! Number of unsent bytes
+		size_t depthBytes() const { return m_bytes; }
+
+		//! Number of messages which are not completely sent
+		size_t depthMessages() const { return m_frames.size(); }
+
+		//! Number of messages dropped to make room
+		uint64_t droppedMessages() const { return m_dropped; }
+
+		//! Number of values removed because a newer value for the same variable was queued
+		uint64_t coalescedValues() const { return m_coalesced; }
+
+		//! True once a message has been rejected under Policy_Disconnect
+		bool overflowed() const { return m_overflowed; }
+
+	private:
+		void coalesce();
+		void dropOldest();
+
+		std::deque<std::vector<char>> m_frames;
+		size_t m_frontSent;
+		size_t m_bytes;
+
+		size_t m_maxBytes;
+		Policy m_policy;
+
+		uint64_t m_dropped;
+		uint64_t m_coalesced;
+		bool m_overflowed;
+	};
+
+}
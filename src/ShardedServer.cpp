@@ -0,0 +1,642 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ShardedServer.h"
+#include "FrameBuffer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace zusi
+{
+	static const size_t READ_CHUNK = 16 * 1024;
+	//! Reads per readiness event, so a busy client cannot starve the others. Epoll is level-triggered and reports the rest again.
+	static const int MAX_READS_PER_EVENT = 4;
+	//! Limit for the incomplete message buffered for a client
+	static const size_t MAX_INPUT_BYTES = 64 * 1024;
+	static const int MAX_EVENTS = 256;
+	static const size_t MAX_IOV = 64;
+
+	enum SessionState
+	{
+		Session_AwaitHello,
+		Session_AwaitNeededData,
+		Session_Established,
+		Session_Closed
+	};
+
+	//! Send queue statistics of one shard, only written by the shard's thread
+	struct ShardedServer::Counters
+	{
+		Counters() : queued_bytes(0), dropped(0), coalesced(0), disconnected(0)
+		{
+		}
+
+		std::atomic<size_t> queued_bytes;
+		std::atomic<uint64_t> dropped;
+		std::atomic<uint64_t> coalesced;
+		std::atomic<uint64_t> disconnected;
+	};
+
+	//! Socket which queues outgoing messages until the shard flushes them
+	class ShardedServer::SessionSocket :
+		public zusi::Socket
+	{
+	public:
+		SessionSocket(std::vector<Session*>* dirty, Session* session, Counters* counters, size_t max_bytes, SendQueue::Policy policy) :
+			m_dirty(dirty), m_session(session), m_counters(counters), m_queue(max_bytes, policy)
+		{
+		}
+
+		//! Receiving is done by the shard
+		virtual int ReadBytes(void*, int) { return -1; }
+
+		virtual int WriteBytes(const void* src, int bytes);
+
+		virtual bool DataToRead() { return false; }
+
+		//! Move the message written so far into the send queue
+		virtual bool Flush();
+
+		std::vector<Session*>* m_dirty;
+		Session* m_session;
+		Counters* m_counters;
+
+		std::vector<char> m_message;
+		SendQueue m_queue;
+	};
+
+	struct ShardedServer::Session
+	{
+		Session(std::vector<Session*>* dirty, Counters* counters, int socket, size_t max_bytes, SendQueue::Policy policy) :
+			fd(socket), state(Session_AwaitHello), socket(dirty, this, counters, max_bytes, policy), connection(&this->socket), want_write(false), dirty(false)
+		{
+		}
+
+		int fd;
+		SessionState state;
+		SessionSocket socket;
+		ServerConnection connection;
+		FrameBuffer input;
+
+		bool want_write;
+		bool dirty;
+	};
+
+	int ShardedServer::SessionSocket::WriteBytes(const void* src, int bytes)
+	{
+		if (!m_session->dirty)
+		{
+			m_session->dirty = true;
+			m_dirty->push_back(m_session);
+		}
+
+		const char* src_chars = static_cast<const char*>(src);
+		m_message.insert(m_message.end(), src_chars, src_chars + bytes);
+		return bytes;
+	}
+
+	bool ShardedServer::SessionSocket::Flush()
+	{
+		size_t bytes = m_queue.depthBytes();
+		uint64_t dropped = m_queue.droppedMessages();
+		uint64_t coalesced = m_queue.coalescedValues();
+
+		bool queued = m_queue.push(m_message.data(), m_message.size());
+		m_message.clear();
+
+		//Unsigned wrap-around gives the right result when coalescing shrinks the queue
+		m_counters->queued_bytes.fetch_add(m_queue.depthBytes() - bytes, std::memory_order_relaxed);
+		m_counters->dropped.fetch_add(m_queue.droppedMessages() - dropped, std::memory_order_relaxed);
+		m_counters->coalesced.fetch_add(m_queue.coalescedValues() - coalesced, std::memory_order_relaxed);
+
+		return queued;
+	}
+
+	//! One worker thread with its own listening socket, epoll loop and sessions
+	class ShardedServer::Shard
+	{
+	public:
+		Shard(int port, size_t queue_capacity, SendQueue::Policy policy, size_t client_queue_bytes);
+		~Shard();
+
+		void start() { m_thread = std::thread(&Shard::run, this); }
+		void stop();
+
+		//! Producer side: queue an update and wake the shard if it may be waiting
+		bool post(const std::shared_ptr<const Values>& values);
+
+		std::atomic<size_t> m_clients;
+		std::atomic<uint64_t> m_messages;
+		Counters m_counters;
+
+	private:
+		void run();
+		void accept();
+		void drainQueue();
+		bool handleReadable(Session& session);
+		//! Handle the complete messages received, close the session on errors
+		bool handleMessages(Session& session);
+		void handleMessage(Session& session, const Node& msg);
+		void flush(Session& session);
+		void flushDirty();
+		void updateEvents(Session& session, bool want_write);
+		void close(Session& session);
+		void removeClosed();
+
+		int m_listen;
+		int m_epoll;
+		int m_wakeup;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+
+		SpscQueue<std::shared_ptr<const Values>> m_queue;
+		//! Set by the producer when it has written to m_wakeup, cleared by the shard before draining
+		std::atomic<bool> m_signalled;
+
+		SendQueue::Policy m_policy;
+		size_t m_clientQueueBytes;
+
+		std::vector<std::unique_ptr<Session>> m_sessions;
+		std::vector<Session*> m_dirty;
+		bool m_haveClosed;
+	};
+
+	ShardedServer::Shard::Shard(int port, size_t queue_capacity, SendQueue::Policy policy, size_t client_queue_bytes) : m_clients(0), m_messages(0),
+		m_listen(-1), m_epoll(-1), m_wakeup(-1), m_running(true), m_queue(queue_capacity), m_signalled(false),
+		m_policy(policy), m_clientQueueBytes(client_queue_bytes), m_haveClosed(false)
+	{
+		m_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+		if (m_listen < 0)
+			throw std::runtime_error("Socket error - Socket creation Failed!");
+
+		int flag = 1;
+		setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+		if (setsockopt(m_listen, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag)) != 0)
+		{
+			::close(m_listen);
+			throw std::runtime_error("Socket error - SO_REUSEPORT not supported");
+		}
+
+		sockaddr_in bind_to = {};
+		bind_to.sin_family = AF_INET;
+		bind_to.sin_addr.s_addr = INADDR_ANY;
+		bind_to.sin_port = htons(port);
+
+		if (bind(m_listen, reinterpret_cast<sockaddr*>(&bind_to), sizeof(bind_to)) != 0 || listen(m_listen, 1024) != 0)
+		{
+			::close(m_listen);
+			throw std::runtime_error("Socket error - Unable to bind socket");
+		}
+
+		m_epoll = epoll_create1(EPOLL_CLOEXEC);
+		m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_epoll < 0 || m_wakeup < 0)
+		{
+			if (m_epoll >= 0)
+				::close(m_epoll);
+			if (m_wakeup >= 0)
+				::close(m_wakeup);
+			::close(m_listen);
+			throw std::runtime_error("Server error - epoll creation failed");
+		}
+
+		//nullptr marks the wakeup event, the shard itself the listening socket
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+
+		ev.data.ptr = this;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listen, &ev);
+	}
+
+	ShardedServer::Shard::~Shard()
+	{
+		stop();
+
+		for (auto& session : m_sessions)
+			if (session->state != Session_Closed)
+				::close(session->fd);
+
+		::close(m_listen);
+		::close(m_wakeup);
+		::close(m_epoll);
+	}
+
+	void ShardedServer::Shard::stop()
+	{
+		m_running = false;
+		uint64_t value = 1;
+		write(m_wakeup, &value, sizeof(value));
+
+		if (m_thread.joinable())
+			m_thread.join();
+	}
+
+	bool ShardedServer::Shard::post(const std::shared_ptr<const Values>& values)
+	{
+		if (!m_queue.push(values))
+			return false;
+
+		//Only one wakeup per batch the shard has not started draining yet
+		if (!m_signalled.exchange(true))
+		{
+			uint64_t value = 1;
+			write(m_wakeup, &value, sizeof(value));
+		}
+
+		return true;
+	}
+
+	void ShardedServer::Shard::run()
+	{
+		epoll_event events[MAX_EVENTS];
+
+		while (m_running)
+		{
+			int count = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+
+			for (int i = 0; i < count; ++i)
+			{
+				void* ptr = events[i].data.ptr;
+				if (ptr == nullptr)
+				{
+					uint64_t value;
+					while (read(m_wakeup, &value, sizeof(value)) > 0);
+					drainQueue();
+				}
+				else if (ptr == this)
+				{
+					accept();
+				}
+				else
+				{
+					Session& session = *static_cast<Session*>(ptr);
+					if (session.state == Session_Closed)
+						continue;
+
+					if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+						if (!handleReadable(session))
+							continue;
+
+					if (events[i].events & EPOLLOUT)
+						flush(session);
+				}
+			}
+
+			flushDirty();
+			removeClosed();
+		}
+	}
+
+	void ShardedServer::Shard::accept()
+	{
+		while (true)
+		{
+			int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd < 0)
+				return;
+
+			int flag = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+			m_sessions.emplace_back(new Session(&m_dirty, &m_counters, fd, m_clientQueueBytes, m_policy));
+			Session& session = *m_sessions.back();
+
+			epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.ptr = &session;
+			if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+			{
+				::close(fd);
+				m_sessions.pop_back();
+			}
+		}
+	}
+
+	void ShardedServer::Shard::drainQueue()
+	{
+		m_signalled = false;
+
+		//Only what is queued now, so a producer which is faster than the shard cannot keep it from its sockets
+		size_t pending = m_queue.size();
+
+		std::shared_ptr<const Values> values;
+		while (pending-- > 0 && m_queue.pop(values))
+		{
+			uint64_t sent = 0;
+			for (auto& session : m_sessions)
+			{
+				if (session->state != Session_Established)
+					continue;
+
+				//A slow client only fills its own queue, the policy decides what happens when it is full
+				if (session->connection.sendData(*values))
+					++sent;
+				else
+					close(*session);
+			}
+			m_messages.fetch_add(sent, std::memory_order_relaxed);
+		}
+
+		//Come back for the rest after the next round of socket events
+		if (m_queue.size() > 0 && !m_signalled.exchange(true))
+		{
+			uint64_t value = 1;
+			write(m_wakeup, &value, sizeof(value));
+		}
+	}
+
+	bool ShardedServer::Shard::handleReadable(Session& session)
+	{
+		for (int reads = 0; reads < MAX_READS_PER_EVENT; ++reads)
+		{
+			char* dest = session.input.prepare(READ_CHUNK);
+			ssize_t received = recv(session.fd, dest, READ_CHUNK, 0);
+
+			if (received > 0)
+			{
+				session.input.commit(received);
+				if (!handleMessages(session))
+					return false;
+				continue;
+			}
+
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				break;
+
+			close(session);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ShardedServer::Shard::handleMessages(Session& session)
+	{
+		try
+		{
+			while (session.state != Session_Closed)
+			{
+				Node msg;
+				if (!session.input.nextMessage(msg))
+					break;
+				handleMessage(session, msg);
+			}
+		}
+		catch (std::runtime_error&)
+		{
+			close(session);
+			return false;
+		}
+
+		//Only the start of an incomplete message is left, which must not grow without limit
+		if (session.input.size() > MAX_INPUT_BYTES)
+		{
+			close(session);
+			return false;
+		}
+
+		return true;
+	}
+
+	void ShardedServer::Shard::handleMessage(Session& session, const Node& msg)
+	{
+		switch (session.state)
+		{
+		case Session_AwaitHello:
+			session.connection.processHello(msg);
+			session.connection.sendHelloAck();
+			session.state = Session_AwaitNeededData;
+			break;
+		case Session_AwaitNeededData:
+			session.connection.processNeededData(msg);
+			session.connection.sendNeededDataAck();
+			session.state = Session_Established;
+			++m_clients;
+			break;
+		default:
+			break;
+		}
+	}
+
+	void ShardedServer::Shard::flush(Session& session)
+	{
+		SendQueue& queue = session.socket.m_queue;
+
+		//All queued messages in one call
+		while (!queue.empty())
+		{
+			SendQueue::Buffer buffers[MAX_IOV];
+			iovec iov[MAX_IOV];
+			size_t count = queue.peek(buffers, MAX_IOV);
+			for (size_t i = 0; i < count; ++i)
+			{
+				iov[i].iov_base = const_cast<char*>(buffers[i].data);
+				iov[i].iov_len = buffers[i].bytes;
+			}
+
+			msghdr msg = {};
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+
+			ssize_t sent = sendmsg(session.fd, &msg, MSG_NOSIGNAL);
+			if (sent < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					break;
+
+				close(session);
+				return;
+			}
+
+			queue.consume(sent);
+			m_counters.queued_bytes.fetch_sub(sent, std::memory_order_relaxed);
+		}
+
+		updateEvents(session, !queue.empty());
+	}
+
+	void ShardedServer::Shard::flushDirty()
+	{
+		for (Session* session : m_dirty)
+		{
+			session->dirty = false;
+			if (session->state != Session_Closed)
+				flush(*session);
+		}
+		m_dirty.clear();
+	}
+
+	void ShardedServer::Shard::updateEvents(Session& session, bool want_write)
+	{
+		if (session.want_write == want_write)
+			return;
+
+		epoll_event ev = {};
+		ev.events = want_write ? static_cast<uint32_t>(EPOLLIN | EPOLLOUT) : static_cast<uint32_t>(EPOLLIN);
+		ev.data.ptr = &session;
+		epoll_ctl(m_epoll, EPOLL_CTL_MOD, session.fd, &ev);
+		session.want_write = want_write;
+	}
+
+	void ShardedServer::Shard::close(Session& session)
+	{
+		if (session.state == Session_Established)
+			--m_clients;
+
+		const SendQueue& queue = session.socket.m_queue;
+		m_counters.queued_bytes.fetch_sub(queue.depthBytes(), std::memory_order_relaxed);
+		if (queue.overflowed())
+			m_counters.disconnected.fetch_add(1, std::memory_order_relaxed);
+
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, session.fd, nullptr);
+		::close(session.fd);
+		session.state = Session_Closed;
+		m_haveClosed = true;
+	}
+
+	void ShardedServer::Shard::removeClosed()
+	{
+		if (!m_haveClosed)
+			return;
+
+		for (auto it = m_sessions.begin(); it != m_sessions.end();)
+		{
+			if ((*it)->state == Session_Closed && !(*it)->dirty)
+				it = m_sessions.erase(it);
+			else
+				++it;
+		}
+		m_haveClosed = false;
+	}
+
+	ShardedServer::ShardedServer(int port, unsigned shards, size_t queue_capacity, SendQueue::Policy policy, size_t client_queue_bytes) : m_dropped(0)
+	{
+		if (shards == 0)
+			shards = 1;
+
+		//All sockets are bound before any thread starts, so a failure leaves nothing running
+		for (unsigned i = 0; i < shards; ++i)
+			m_shards.emplace_back(new Shard(port, queue_capacity, policy, client_queue_bytes));
+
+		for (auto& shard : m_shards)
+			shard->start();
+	}
+
+	ShardedServer::~ShardedServer()
+	{
+		stop();
+	}
+
+	bool ShardedServer::publish(const Values& values)
+	{
+		//One copy shared by all shards
+		std::shared_ptr<const Values> shared(new Values(values));
+
+		bool complete = true;
+		for (auto& shard : m_shards)
+		{
+			if (!shard->post(shared))
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				complete = false;
+			}
+		}
+		return complete;
+	}
+
+	void ShardedServer::stop()
+	{
+		for (auto& shard : m_shards)
+			shard->stop();
+	}
+
+	size_t ShardedServer::clientCount() const
+	{
+		size_t count = 0;
+		for (const auto& shard : m_shards)
+			count += shard->m_clients;
+		return count;
+	}
+
+	uint64_t ShardedServer::messagesSent() const
+	{
+		uint64_t count = 0;
+		for (const auto& shard : m_shards)
+			count += shard->m_messages.load(std::memory_order_relaxed);
+		return count;
+	}
+
+	uint64_t ShardedServer::updatesDropped() const
+	{
+		return m_dropped.load(std::memory_order_relaxed);
+	}
+
+	size_t ShardedServer::queuedBytes() const
+	{
+		size_t bytes = 0;
+		for (const auto& shard : m_shards)
+			bytes += shard->m_counters.queued_bytes.load(std::memory_order_relaxed);
+		return bytes;
+	}
+
+	uint64_t ShardedServer::clientMessagesDropped() const
+	{
+		uint64_t count = 0;
+		for (const auto& shard : m_shards)
+			count += shard->m_counters.dropped.load(std::memory_order_relaxed);
+		return count;
+	}
+
+	uint64_t ShardedServer::clientValuesCoalesced() const
+	{
+		uint64_t count = 0;
+		for (const auto& shard : m_shards)
+			count += shard->m_counters.coalesced.load(std::memory_order_relaxed);
+		return count;
+	}
+
+	uint64_t ShardedServer::clientsDisconnected() const
+	{
+		uint64_t count = 0;
+		for (const auto& shard : m_shards)
+			count += shard->m_counters.disconnected.load(std::memory_order_relaxed);
+		return count;
+	}
+
+}
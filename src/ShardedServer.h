@@ -0,0 +1,120 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "SendQueue.h"
+#include "SpscQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Emulated Zusi server for thousands of clients, spread over several threads
+	*
+	* Each shard is a thread with its own listening socket bound to the same port
+	* with SO_REUSEPORT, its own epoll loop and its own ServerConnection sessions.
+	* The kernel distributes incoming connections between the shards, and shards
+	* share no mutable state with each other.
+	*
+	* Value updates are published by a single producer thread and passed to every
+	* shard through a lock-free SpscQueue. Each shard then sends the requested
+	* part of the update to its clients. Messages received from clients after the
+	* handshake are discarded.
+	*
+	* Every client has a bounded SendQueue, so a client which stops reading never
+	* delays the others. The queue policy decides what happens when it is full.
+	*/
+	class ShardedServer
+	{
+	public:
+		//! One set of Fuehrerstand values
+		typedef std::vector<std::pair<FuehrerstandData, float>> Values;
+
+		/**
+		* @brief Start listening and run the shards
+		* @param port Port to listen on, usually 1436
+		* @param shards Number of worker threads
+		* @param queue_capacity Number of updates each shard can hold before publish() drops them
+		* @param policy What to do when a client's send queue is full
+		* @param client_queue_bytes Size limit of each client's send queue
+		* @throws std::runtime_error if a listening socket cannot be set up
+		*/
+		ShardedServer(int port, unsigned shards, size_t queue_capacity = 1024,
+			SendQueue::Policy policy = SendQueue::Policy_Coalesce, size_t client_queue_bytes = 256 * 1024);
+
+		//! Stops the shards and closes all connections
+		~ShardedServer();
+
+		/**
+		* @brief Send values to all clients
+		*
+		* Must always be called from the same thread.
+		* @return False if the update was dropped for at least one shard because its queue was full
+		*/
+		bool publish(const Values& values);
+
+		//! Stop the shards. Called by the destructor.
+		void stop();
+
+		//! Number of worker threads
+		unsigned shardCount() const { return static_cast<unsigned>(m_shards.size()); }
+
+		//! Number of clients which have completed the handshake
+		size_t clientCount() const;
+
+		//! Number of updates passed to clients, counted once per client
+		uint64_t messagesSent() const;
+
+		//! Number of updates dropped because a shard's queue was full, counted once per shard
+		uint64_t updatesDropped() const;
+
+		//! Number of bytes waiting in the clients' send queues
+		size_t queuedBytes() const;
+
+		//! Number of messages dropped from clients' send queues
+		uint64_t clientMessagesDropped() const;
+
+		//! Number of values merged away in clients' send queues
+		uint64_t clientValuesCoalesced() const;
+
+		//! Number of clients disconnected because their send queue was full
+		uint64_t clientsDisconnected() const;
+
+	private:
+		class Shard;
+		class SessionSocket;
+		struct Session;
+		struct Counters;
+
+		ShardedServer(const ShardedServer& other);
+
+		std::vector<std::unique_ptr<Shard>> m_shards;
+		std::atomic<uint64_t> m_dropped;
+	};
+
+}
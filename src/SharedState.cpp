@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "SharedState.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace zusi
+{
+	using namespace shared_state;
+
+	template<size_t DataBytes> static void writeSlot(Slot<DataBytes>& slot, uint16_t kind, const void* data, size_t bytes)
+	{
+		if (bytes > DataBytes)
+		{
+			kind = Kind_Overflow;
+			bytes = 0;
+		}
+
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.kind = kind;
+		slot.bytes = static_cast<uint16_t>(bytes);
+		memcpy(slot.data, data, bytes);
+
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	//! Attempts before a reader starts yielding to a publisher which may have been descheduled mid-write
+	static const unsigned READ_SPINS = 100;
+	//! Time after which a slot which stays locked is given up, as its publisher has probably died
+	static const std::chrono::milliseconds READ_TIMEOUT(50);
+
+	template<size_t DataBytes> static size_t readSlot(const Slot<DataBytes>& slot, void* dest, uint16_t& kind)
+	{
+		std::chrono::steady_clock::time_point deadline;
+		for (unsigned attempt = 0; ; ++attempt)
+		{
+			if (attempt >= READ_SPINS)
+			{
+				auto now = std::chrono::steady_clock::now();
+				if (attempt == READ_SPINS)
+				{
+					deadline = now + READ_TIMEOUT;
+				}
+				else if (now >= deadline)
+				{
+					kind = Kind_Unavailable;
+					return 0;
+				}
+				std::this_thread::yield();
+			}
+
+			uint32_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before & 1)
+				continue;
+
+			kind = slot.kind;
+			size_t bytes = slot.bytes;
+			if (bytes > DataBytes)
+				continue;
+			memcpy(dest, slot.data, bytes);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == before)
+				return bytes;
+		}
+	}
+
+	SharedStatePublisher::SharedStatePublisher(const char* name) : m_name(name)
+	{
+		//Never reuse an existing segment: clearing it would wipe values under readers which have it mapped
+		shm_unlink(name);
+		int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0)
+			throw std::runtime_error("Shared memory error - unable to create segment");
+
+		if (ftruncate(fd, sizeof(Segment)) != 0)
+		{
+			close(fd);
+			shm_unlink(name);
+			throw std::runtime_error("Shared memory error - unable to size segment");
+		}
+
+		void* memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+		{
+			shm_unlink(name);
+			throw std::runtime_error("Shared memory error - unable to map segment");
+		}
+
+		//The new segment is zero-filled. Readers check the magic number last.
+		m_segment = static_cast<Segment*>(memory);
+		m_segment->header.layout_version = LAYOUT_VERSION;
+		std::atomic_thread_fence(std::memory_order_release);
+		m_segment->header.magic = MAGIC;
+	}
+
+	SharedStatePublisher::~SharedStatePublisher()
+	{
+		munmap(m_segment, sizeof(Segment));
+		shm_unlink(m_name.c_str());
+	}
+
+	void SharedStatePublisher::publish(const Node& msg)
+	{
+		if (msg.getId() != MsgType_Fahrpult)
+			return;
+
+		for (const Node* node : msg.nodes)
+		{
+			if (node->getId() == Cmd_DATA_FTD)
+				publishFtd(*node);
+			else if (node->getId() == Cmd_DATA_PROG)
+				publishProg(*node);
+		}
+
+		m_segment->header.updates.fetch_add(1, std::memory_order_release);
+	}
+
+	void SharedStatePublisher::publishFtd(const Node& data)
+	{
+		for (const Attribute* att : data.attributes)
+			if (att->getId() < FTD_SLOTS)
+				writeSlot(m_segment->ftd[att->getId()], Kind_Attribute, att->data, att->data_bytes);
+
+		//Composite values such as Sifa: flatten the attributes of the sub-node
+		char flat[FTD_SLOT_BYTES];
+		for (const Node* sub : data.nodes)
+		{
+			if (sub->getId() >= FTD_SLOTS)
+				continue;
+
+			size_t bytes = 0;
+			bool fits = sub->nodes.empty();
+			for (const Attribute* att : sub->attributes)
+			{
+				if (!fits || bytes + 2 * sizeof(uint16_t) + att->data_bytes > sizeof(flat))
+				{
+					fits = false;
+					break;
+				}
+
+				uint16_t id = att->getId();
+				uint16_t length = static_cast<uint16_t>(att->data_bytes);
+				memcpy(flat + bytes, &id, sizeof(id));
+				memcpy(flat + bytes + sizeof(id), &length, sizeof(length));
+				memcpy(flat + bytes + 2 * sizeof(uint16_t), att->data, att->data_bytes);
+				bytes += 2 * sizeof(uint16_t) + att->data_bytes;
+			}
+
+			if (fits)
+				writeSlot(m_segment->ftd[sub->getId()], Kind_Node, flat, bytes);
+			else
+				writeSlot(m_segment->ftd[sub->getId()], Kind_Overflow, flat, 0);
+		}
+	}
+
+	void SharedStatePublisher::publishProg(const Node& data)
+	{
+		for (const Attribute* att : data.attributes)
+			if (att->getId() < PROG_SLOTS)
+				writeSlot(m_segment->prog[att->getId()], Kind_Attribute, att->data, att->data_bytes);
+	}
+
+	SharedStateReader::SharedStateReader(const char* name)
+	{
+		int fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0)
+			throw std::runtime_error("Shared memory error - segment does not exist");
+
+		void* memory = mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+			throw std::runtime_error("Shared memory error - unable to map segment");
+
+		m_segment = static_cast<const Segment*>(memory);
+		if (m_segment->header.magic != MAGIC || m_segment->header.layout_version != LAYOUT_VERSION)
+		{
+			munmap(memory, sizeof(Segment));
+			throw std::runtime_error("Shared memory error - segment is not initialised or has a different layout");
+		}
+	}
+
+	SharedStateReader::~SharedStateReader()
+	{
+		munmap(const_cast<Segment*>(m_segment), sizeof(Segment));
+	}
+
+	bool SharedStateReader::readFloat(FuehrerstandData id, float& value) const
+	{
+		if (static_cast<uint32_t>(id) >= FTD_SLOTS)
+			return false;
+
+		char data[FTD_SLOT_BYTES];
+		uint16_t kind;
+		size_t bytes = readSlot(m_segment->ftd[id], data, kind);
+		if (kind != Kind_Attribute || bytes != sizeof(float))
+			return false;
+
+		memcpy(&value, data, sizeof(value));
+		return true;
+	}
+
+	size_t SharedStateReader::readRaw(FuehrerstandData id, void* dest, uint16_t& kind) const
+	{
+		kind = Kind_Empty;
+		if (static_cast<uint32_t>(id) >= FTD_SLOTS)
+			return 0;
+
+		return readSlot(m_segment->ftd[id], dest, kind);
+	}
+
+	std::string SharedStateReader::readProg(ProgData id) const
+	{
+		if (static_cast<uint32_t>(id) >= PROG_SLOTS)
+			return std::string();
+
+		char data[PROG_SLOT_BYTES];
+		uint16_t kind;
+		size_t bytes = readSlot(m_segment->prog[id], data, kind);
+		if (kind != Kind_Attribute)
+			return std::string();
+
+		return std::string(data, bytes);
+	}
+
+	uint32_t SharedStateReader::sequence(FuehrerstandData id) const
+	{
+		if (static_cast<uint32_t>(id) >= FTD_SLOTS)
+			return 0;
+
+		return m_segment->ftd[id].sequence.load(std::memory_order_acquire);
+	}
+
+	uint64_t SharedStateReader::updates() const
+	{
+		return m_segment->header.updates.load(std::memory_order_acquire);
+	}
+
+}
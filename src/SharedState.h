@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <atomic>
+#include <string>
+
+namespace zusi
+{
+
+	/**
+	* @brief Layout of the shared memory segment used by SharedStatePublisher and SharedStateReader
+	*
+	* The segment holds a header followed by a fixed table with one slot per
+	* Fuehrerstand Data ID and one per program status ID. Each slot is guarded by
+	* its own sequence lock: the sequence is odd while the publisher writes the slot.
+	*/
+	namespace shared_state
+	{
+		static const uint32_t MAGIC = 0x5A555349;
+		static const uint32_t LAYOUT_VERSION = 1;
+
+		//! Number of Fuehrerstand Data slots, IDs at or above this are not published
+		static const uint32_t FTD_SLOTS = 1024;
+		//! Number of program status slots
+		static const uint32_t PROG_SLOTS = 32;
+
+		//! Data capacity of a Fuehrerstand slot
+		static const size_t FTD_SLOT_BYTES = 56;
+		//! Data capacity of a program status slot
+		static const size_t PROG_SLOT_BYTES = 508;
+
+		//! Content type of a slot
+		enum SlotKind
+		{
+			//! Nothing received yet
+			Kind_Empty = 0,
+			//! Data of a single attribute, e.g. a float
+			Kind_Attribute = 1,
+			//! Attributes of a sub-node, as a sequence of (uint16_t id, uint16_t length, data)
+			Kind_Node = 2,
+			//! Value did not fit into the slot
+			Kind_Overflow = 3,
+			//! Reported by SharedStateReader only: the slot stayed locked, e.g. because the publisher died while writing it
+			Kind_Unavailable = 4
+		};
+
+		//! One table entry, sized so that Fuehrerstand slots fill a cache line
+		template<size_t DataBytes> struct Slot
+		{
+			std::atomic<uint32_t> sequence;
+			uint16_t kind;
+			uint16_t bytes;
+			char data[DataBytes];
+		};
+
+		typedef Slot<FTD_SLOT_BYTES> FtdSlot;
+		typedef Slot<PROG_SLOT_BYTES> ProgSlot;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t layout_version;
+			//! Incremented after every published message
+			std::atomic<uint64_t> updates;
+			char padding[48];
+		};
+
+		struct Segment
+		{
+			Header header;
+			FtdSlot ftd[FTD_SLOTS];
+			ProgSlot prog[PROG_SLOTS];
+		};
+	}
+
+	/**
+	* @brief Publishes received values into a POSIX shared memory segment (Linux)
+	*
+	* Feed every message received by one ClientConnection to publish(). Other local
+	* processes can then read the latest values with SharedStateReader, without
+	* their own connection to Zusi.
+	*/
+	class SharedStatePublisher
+	{
+	public:
+		/**
+		* @brief Create the shared memory segment
+		*
+		* A segment left with the same name, e.g. by a publisher which crashed, is
+		* removed and a new one created. Readers which still map the old segment
+		* keep seeing its last values and must be reopened.
+		* @param name Segment name, e.g. "/zusi3tcp"
+		* @throws std::runtime_error if the segment cannot be created
+		*/
+		explicit SharedStatePublisher(const char* name);
+
+		//! Unmaps and removes the segment
+		~SharedStatePublisher();
+
+		//! Store the values of a DATA_FTD or DATA_PROG message, other messages are ignored
+		void publish(const Node& msg);
+
+	private:
+		SharedStatePublisher(const SharedStatePublisher& other);
+
+		void publishFtd(const Node& data);
+		void publishProg(const Node& data);
+
+		std::string m_name;
+		shared_state::Segment* m_segment;
+	};
+
+	/**
+	* @brief Read-only view of a segment created by SharedStatePublisher (Linux)
+	*
+	* All reads are lock-free and never block the publisher. A read which overlaps
+	* an update of the same slot is retried.
+	*/
+	class SharedStateReader
+	{
+	public:
+		/**
+		* @brief Map an existing segment read-only
+		* @param name Segment name passed to the publisher
+		* @throws std::runtime_error if the segment does not exist or has a different layout
+		*/
+		explicit SharedStateReader(const char* name);
+
+		~SharedStateReader();
+
+		/**
+		* @brief Read a float Fuehrerstand value
+		* @return False if no value has been published for id, or the slot is unavailable
+		*/
+		bool readFloat(FuehrerstandData id, float& value) const;
+
+		/**
+		* @brief Copy the raw content of a Fuehrerstand slot
+		* @param id Fuehrerstand Data ID
+		* @param dest Buffer of at least shared_state::FTD_SLOT_BYTES bytes
+		* @param kind Receives the shared_state::SlotKind of the value, Kind_Unavailable if the slot stayed locked
+		* @return Number of bytes copied
+		*/
+		size_t readRaw(FuehrerstandData id, void* dest, uint16_t& kind) const;
+
+		//! Read a program status value, empty if not published or unavailable
+		std::string readProg(ProgData id) const;
+
+		/**
+		* @brief Sequence number of a Fuehrerstand slot
+		*
+		* Changes whenever the value is written, so it can be polled to detect updates.
+		*/
+		uint32_t sequence(FuehrerstandData id) const;
+
+		//! Number of messages published so far
+		uint64_t updates() const;
+
+	private:
+		SharedStateReader(const SharedStateReader& other);
+
+		const shared_state::Segment* m_segment;
+	};
+
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief Bounded lock-free queue for exactly one producer and one consumer thread
+	*
+	* push() must only be called from the producer thread and pop() only from the
+	* consumer thread. The indices are kept on separate cache lines, and each side
+	* keeps a cached copy of the other side's index so that the shared one is only
+	* read when the queue appears full or empty.
+	*/
+	template <typename T>
+	class SpscQueue
+	{
+	public:
+		/**
+		* @brief Create an empty queue
+		* @param capacity Maximum number of elements, rounded up to a power of two
+		*/
+		explicit SpscQueue(size_t capacity) : m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size *= 2;
+			m_slots.resize(size);
+			m_mask = size - 1;
+		}
+
+		/**
+		* @brief Append an element. Producer thread only.
+		* @return False if the queue is full, the element is not moved from in that case
+		*/
+		bool push(T&& value)
+		{
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_cachedHead > m_mask)
+			{
+				m_cachedHead = m_head.load(std::memory_order_acquire);
+				if (tail - m_cachedHead > m_mask)
+					return false;
+			}
+
+			m_slots[tail & m_mask] = std::move(value);
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		//! Append a copy of an element. Producer thread only.
+		bool push(const T& value)
+		{
+			T copy(value);
+			return push(std::move(copy));
+		}
+
+		/**
+		* @brief Remove the oldest element. Consumer thread only.
+		* @param dest Receives the element
+		* @return False if the queue is empty
+		*/
+		bool pop(T& dest)
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_cachedTail)
+			{
+				m_cachedTail = m_tail.load(std::memory_order_acquire);
+				if (head == m_cachedTail)
+					return false;
+			}
+
+			dest = std::move(m_slots[head & m_mask]);
+			//Release what the slot held now rather than when it is next overwritten
+			m_slots[head & m_mask] = T();
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		//! Number of queued elements. Exact only when called from the producer or consumer thread.
+		size_t size() const
+		{
+			return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+		}
+
+		//! Maximum number of elements
+		size_t capacity() const
+		{
+			return m_mask + 1;
+		}
+
+	private:
+		SpscQueue(const SpscQueue& other);
+		SpscQueue& operator=(const SpscQueue& other);
+
+		//Padding keeps the two sides on separate cache lines without requiring over-aligned allocation
+		static const size_t CACHE_LINE = 64;
+
+		std::vector<T> m_slots;
+		size_t m_mask;
+		char m_pad0[CACHE_LINE];
+
+		//Consumer side
+		std::atomic<size_t> m_head;
+		size_t m_cachedTail;
+		char m_pad1[CACHE_LINE];
+
+		//Producer side
+		std::atomic<size_t> m_tail;
+		size_t m_cachedHead;
+		char m_pad2[CACHE_LINE];
+	};
+
+}
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "StateFrame.h"
+
+namespace zusi
+{
+	//! Bytes from the start of one Byte attribute's value to the next: its data, then length and ID of the next attribute
+	static const size_t BYTE_ATTRIBUTE_STRIDE = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t);
+
+	//! Bytes from the start of an attribute to its value
+	static const size_t ATTRIBUTE_HEADER_BYTES = sizeof(uint32_t) + sizeof(uint16_t);
+
+	//! Bytes from the start of a node to its first item
+	static const size_t NODE_HEADER_BYTES = sizeof(uint32_t) + sizeof(uint16_t);
+
+	StateFrame::StateFrame(const std::set<FuehrerstandData>& fs_data)
+	{
+		FrameWriter writer;
+		writer.beginNode(MsgType_Fahrpult);
+		writer.beginNode(Cmd_DATA_FTD);
+
+		if (!fs_data.empty())
+			m_offsets.resize(static_cast<size_t>(*fs_data.rbegin()) + 1, 0);
+
+		for (FuehrerstandData id : fs_data)
+		{
+			size_t start = writer.size();
+			if (id == Fs_Sifa)
+			{
+				FsDataValue(SifaState()).appendTo(writer);
+				m_offsets[id] = static_cast<uint32_t>(start + NODE_HEADER_BYTES + ATTRIBUTE_HEADER_BYTES);
+			}
+			else
+			{
+				writer.attrFloat(static_cast<uint16_t>(id), 0.0f);
+				m_offsets[id] = static_cast<uint32_t>(start + ATTRIBUTE_HEADER_BYTES);
+			}
+		}
+
+		writer.endNode();
+		writer.endNode();
+		m_frame.assign(writer.data(), writer.data() + writer.size());
+	}
+
+	void StateFrame::setSifa(FuehrerstandData id, const SifaState& sifa)
+	{
+		uint32_t pos = offset(id);
+		if (pos == 0)
+			return;
+		if (id != Fs_Sifa)
+			throw std::runtime_error("Encoding error - only Fs_Sifa is a Sifa structure");
+
+		//Same values as FsDataValue::appendTo(), attributes 2 to 6
+		char* value = &m_frame[pos];
+		value[1 * BYTE_ATTRIBUTE_STRIDE] = sifa.licht;
+		value[2 * BYTE_ATTRIBUTE_STRIDE] = sifa.hupebrems ? 2 : sifa.hupewarning ? 1 : 0;
+		value[3 * BYTE_ATTRIBUTE_STRIDE] = sifa.hauptschalter + 1;
+		value[4 * BYTE_ATTRIBUTE_STRIDE] = sifa.storschalter + 1;
+		value[5 * BYTE_ATTRIBUTE_STRIDE] = sifa.luftabsper + 1;
+	}
+
+}
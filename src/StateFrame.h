@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <set>
+#include <vector>
+
+namespace zusi
+{
+
+	/**
+	* @brief DATA_FTD message with every variable of a subscription, encoded once and updated in place
+	*
+	* For clients which are sent the full state on every tick. The IDs, lengths and
+	* nodes of the message stay the same from tick to tick, so the message is encoded
+	* once with a table of where each value is. Setting a value then only overwrites
+	* its bytes in the message, which can be sent as it is.
+	*
+	* Fs_Sifa is encoded as its structure, all other variables as Single. Values
+	* start as 0, and the Sifa in its default state (see SifaFsDataItem).
+	*/
+	class StateFrame
+	{
+	public:
+		//! Encode the message for a set of variables, in ID order
+		explicit StateFrame(const std::set<FuehrerstandData>& fs_data);
+
+		//! True if the variable is part of the message
+		bool contains(FuehrerstandData id) const { return offset(id) != 0; }
+
+		/**
+		* @brief Overwrite a variable's value; ignored if the variable is not part of the message
+		* @throws std::runtime_error if the item is not of the kind encoded for its ID
+		*/
+		void set(const FsDataValue& item)
+		{
+			if (item.kind() == FsDataValue::Kind_Float)
+				setFloat(item.getId(), item.valueFloat());
+			else
+				setSifa(item.getId(), item.valueSifa());
+		}
+
+		/**
+		* @brief Overwrite a Single value; ignored if the variable is not part of the message
+		* @throws std::runtime_error if id is Fs_Sifa
+		*/
+		void setFloat(FuehrerstandData id, float value)
+		{
+			uint32_t pos = offset(id);
+			if (pos == 0)
+				return;
+			if (id == Fs_Sifa)
+				throw std::runtime_error("Encoding error - Fs_Sifa is not a Single");
+			memcpy(&m_frame[pos], &value, sizeof(value));
+		}
+
+		/**
+		* @brief Overwrite the Sifa structure; ignored if the variable is not part of the message
+		* @throws std::runtime_error if id is not Fs_Sifa
+		*/
+		void setSifa(FuehrerstandData id, const SifaState& sifa);
+
+		//! The encoded message including the message header
+		const char* data() const { return m_frame.data(); }
+
+		//! Size of the encoded message
+		size_t size() const { return m_frame.size(); }
+
+	private:
+		//! Position of a variable's value in m_frame; 0, which is within the message header, if it is not part of the message
+		uint32_t offset(FuehrerstandData id) const
+		{
+			size_t index = static_cast<size_t>(id);
+			return index < m_offsets.size() ? m_offsets[index] : 0;
+		}
+
+		std::vector<char> m_frame;
+		//! Indexed by ID; for Fs_Sifa the position of the first attribute's value
+		std::vector<uint32_t> m_offsets;
+	};
+
+}
@@ -0,0 +1,319 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+#include "FrameReader.h"
+
+#include <cstring>
+
+namespace zusi
+{
+
+	namespace subscription
+	{
+		//! Encoded message held in a constexpr array
+		template <size_t N>
+		struct Frame
+		{
+			char data[N];
+
+			static constexpr size_t size() { return N; }
+		};
+
+		//! Position of each variable's value, indexed by ID, -1 for IDs not subscribed
+		template <size_t N>
+		struct SlotTable
+		{
+			int16_t slot[N];
+		};
+
+		//! Bytes of a NEEDED_DATA message for count variables
+		constexpr size_t neededDataBytes(size_t count)
+		{
+			//Three node starts and ends, then a Word attribute for each variable
+			return 3 * (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint32_t)) + count * (sizeof(uint32_t) + 2 * sizeof(uint16_t));
+		}
+
+		//! Constexpr functions are single return statements, as VS2015 only supports C++11 constexpr
+		constexpr uint16_t maxId(const uint16_t* ids, size_t count, uint16_t result = 0)
+		{
+			return count == 0 ? result : maxId(ids + 1, count - 1, ids[0] > result ? ids[0] : result);
+		}
+
+		constexpr bool contains(const uint16_t* ids, size_t count, uint16_t id)
+		{
+			return count != 0 && (ids[0] == id || contains(ids + 1, count - 1, id));
+		}
+
+		constexpr bool unique(const uint16_t* ids, size_t count)
+		{
+			return count == 0 || (!contains(ids + 1, count - 1, ids[0]) && unique(ids + 1, count - 1));
+		}
+
+		constexpr int indexOf(const uint16_t* ids, size_t count, uint16_t id, int index = 0)
+		{
+			return count == 0 ? -1 : (ids[0] == id ? index : indexOf(ids + 1, count - 1, id, index + 1));
+		}
+
+		//! Compile time list of array indices
+		template <size_t... I>
+		struct Indices
+		{
+		};
+
+		template <class A, class B>
+		struct JoinIndices;
+
+		template <size_t... A, size_t... B>
+		struct JoinIndices<Indices<A...>, Indices<B...>>
+		{
+			typedef Indices<A..., (sizeof...(A) + B)...> type;
+		};
+
+		//! Indices 0 to N-1, split in halves to keep the instantiation depth low for large N
+		template <size_t N>
+		struct MakeIndices
+		{
+			typedef typename JoinIndices<typename MakeIndices<N / 2>::type, typename MakeIndices<N - N / 2>::type>::type type;
+		};
+
+		template <>
+		struct MakeIndices<0>
+		{
+			typedef Indices<> type;
+		};
+
+		template <>
+		struct MakeIndices<1>
+		{
+			typedef Indices<0> type;
+		};
+
+		//! Byte i of value, little-endian as on the wire
+		constexpr char byteOf(uint32_t value, size_t i)
+		{
+			return static_cast<char>((value >> (8 * i)) & 0xFF);
+		}
+
+		//! Message, command and 0xA node starts
+		static const size_t NEEDED_DATA_HEADER_BYTES = 3 * (sizeof(uint32_t) + sizeof(uint16_t));
+
+		//! Word attribute holding one variable ID
+		static const size_t NEEDED_DATA_ATTRIBUTE_BYTES = sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+		constexpr char neededDataHeaderByte(size_t i)
+		{
+			return i < 4 ? 0 :
+				i < 6 ? byteOf(MsgType_Fahrpult, i - 4) :
+				i < 10 ? 0 :
+				i < 12 ? byteOf(Cmd_NEEDED_DATA, i - 10) :
+				i < 16 ? 0 :
+				byteOf(0xA, i - 16);
+		}
+
+		constexpr char neededDataAttributeByte(uint16_t id, size_t i)
+		{
+			return i < 4 ? byteOf(sizeof(uint16_t) + sizeof(uint16_t), i) :
+				i < 6 ? byteOf(1, i - 4) :
+				byteOf(id, i - 6);
+		}
+
+		//! Byte i of the NEEDED_DATA message for ids, ending with three node ends
+		constexpr char neededDataByte(const uint16_t* ids, size_t count, size_t i)
+		{
+			return i < NEEDED_DATA_HEADER_BYTES ? neededDataHeaderByte(i) :
+				i < NEEDED_DATA_HEADER_BYTES + count * NEEDED_DATA_ATTRIBUTE_BYTES ?
+					neededDataAttributeByte(ids[(i - NEEDED_DATA_HEADER_BYTES) / NEEDED_DATA_ATTRIBUTE_BYTES], (i - NEEDED_DATA_HEADER_BYTES) % NEEDED_DATA_ATTRIBUTE_BYTES) :
+				byteOf(0xFFFFFFFF, 0);
+		}
+
+		template <size_t... I>
+		constexpr Frame<sizeof...(I)> neededDataFrame(const uint16_t* ids, size_t count, Indices<I...>)
+		{
+			return Frame<sizeof...(I)>{ { neededDataByte(ids, count, I)... } };
+		}
+
+		template <size_t... I>
+		constexpr SlotTable<sizeof...(I)> slotTable(const uint16_t* ids, size_t count, Indices<I...>)
+		{
+			return SlotTable<sizeof...(I)>{ { static_cast<int16_t>(indexOf(ids, count, static_cast<uint16_t>(I)))... } };
+		}
+
+		//! IDs of a subscription as an array
+		template <FuehrerstandData... Ids>
+		struct IdList
+		{
+			static constexpr uint16_t ids[] = { static_cast<uint16_t>(Ids)... };
+		};
+
+		template <FuehrerstandData... Ids>
+		constexpr uint16_t IdList<Ids...>::ids[];
+
+		template <FuehrerstandData... Ids>
+		constexpr Frame<neededDataBytes(sizeof...(Ids))> neededData()
+		{
+			return neededDataFrame(IdList<Ids...>::ids, sizeof...(Ids), typename MakeIndices<neededDataBytes(sizeof...(Ids))>::type());
+		}
+
+		template <size_t N, FuehrerstandData... Ids>
+		constexpr SlotTable<N> slots()
+		{
+			return slotTable(IdList<Ids...>::ids, sizeof...(Ids), typename MakeIndices<N>::type());
+		}
+	}
+
+	/**
+	* @brief Subscription to a fixed set of Fuehrerstand variables, decoded into an array
+	*
+	* The NEEDED_DATA message and the table from variable ID to array position are
+	* built at compile time. Decoding a DATA_FTD message copies each subscribed Single
+	* value straight to its place in Values, with one table lookup per attribute.
+	*
+	* Only variables sent as Single can be subscribed this way; for others, nodes
+	* such as Fs_Sifa, program data and inputs use the connect() overload taking vectors.
+	*
+	* @code
+	* typedef Subscription<Fs_Geschwindigkeit, Fs_DruckBremszylinder> Cab;
+	* Cab::connect(con, "Display");
+	*
+	* Cab::Values values;
+	* FrameReader reader;
+	* while (con.receiveFrame(reader))
+	* {
+	*     Cab::decode(reader, values);
+	*     show(values.get<Fs_Geschwindigkeit>());
+	* }
+	* @endcode
+	*/
+	template <FuehrerstandData... Ids>
+	class Subscription
+	{
+	public:
+		//! Number of subscribed variables
+		static constexpr size_t COUNT = sizeof...(Ids);
+
+		//! Highest subscribed ID
+		static constexpr uint16_t MAX_ID = subscription::maxId(subscription::IdList<Ids...>::ids, COUNT);
+
+		static_assert(COUNT > 0, "Subscription needs at least one variable");
+		static_assert(subscription::unique(subscription::IdList<Ids...>::ids, COUNT), "Subscription lists a variable twice");
+
+		typedef subscription::Frame<subscription::neededDataBytes(sizeof...(Ids))> NeededDataFrame;
+		typedef subscription::SlotTable<MAX_ID + 1> Slots;
+
+		//! Encoded NEEDED_DATA message including the message header
+		static constexpr NeededDataFrame NEEDED_DATA = subscription::neededData<Ids...>();
+
+		//! Position of each variable in Values::value, indexed by ID
+		static constexpr Slots SLOTS = subscription::slots<MAX_ID + 1, Ids...>();
+
+		//! Position of id in Values::value, -1 if it is not subscribed
+		static constexpr int slot(uint16_t id)
+		{
+			return subscription::indexOf(subscription::IdList<Ids...>::ids, COUNT, id);
+		}
+
+		//! Latest value of each variable, in the order of the template arguments
+		struct Values
+		{
+			Values() : value()
+			{
+			}
+
+			float value[COUNT];
+
+			//! Latest value of variable Id
+			template <FuehrerstandData Id>
+			float get() const
+			{
+				static_assert(slot(Id) >= 0, "Variable is not part of the subscription");
+				return value[slot(Id)];
+			}
+		};
+
+		/**
+		* @brief Set up connection to server, subscribing to the variables
+		* @see ClientConnection::connect()
+		*/
+		static bool connect(ClientConnection& con, const char* client_id, bool pipelined = false)
+		{
+			return con.connect(client_id, NEEDED_DATA.data, NEEDED_DATA.size(), pipelined);
+		}
+
+		/**
+		* @brief Copy the subscribed values of a DATA_FTD message into dest
+		*
+		* Values which are not in the message keep their previous value. Other messages
+		* and commands are skipped.
+		* @param reader Reader positioned at the start of the message, e.g. by Connection::receiveFrame()
+		* @param dest Values to update
+		* @return Number of values copied
+		*/
+		static size_t decode(FrameReader& reader, Values& dest)
+		{
+			if (reader.messageType() != MsgType_Fahrpult)
+				return 0;
+
+			size_t copied = 0;
+			while (reader.next())
+			{
+				if (reader.item() == FrameReader::Item_Attribute)
+				{
+					//Commands other than DATA_FTD and nodes within it are skipped below, so only its attributes get here
+					uint16_t id = reader.id();
+					if (reader.depth() == 1 && id <= MAX_ID && SLOTS.slot[id] >= 0 && reader.dataBytes() == sizeof(float))
+					{
+						memcpy(&dest.value[SLOTS.slot[id]], reader.data(), sizeof(float));
+						++copied;
+					}
+				}
+				else if (reader.item() == FrameReader::Item_NodeStart && (reader.depth() != 1 || reader.id() != Cmd_DATA_FTD))
+				{
+					reader.skipNode();
+				}
+			}
+
+			return copied;
+		}
+
+		//! Copy the subscribed values of a DATA_FTD message including the message header into dest
+		static size_t decode(const void* frame, size_t bytes, Values& dest)
+		{
+			FrameReader reader(frame, bytes);
+			return decode(reader, dest);
+		}
+	};
+
+	template <FuehrerstandData... Ids>
+	constexpr size_t Subscription<Ids...>::COUNT;
+
+	template <FuehrerstandData... Ids>
+	constexpr uint16_t Subscription<Ids...>::MAX_ID;
+
+	template <FuehrerstandData... Ids>
+	constexpr typename Subscription<Ids...>::NeededDataFrame Subscription<Ids...>::NEEDED_DATA;
+
+	template <FuehrerstandData... Ids>
+	constexpr typename Subscription<Ids...>::Slots Subscription<Ids...>::SLOTS;
+
+}
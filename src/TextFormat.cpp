@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "TextFormat.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace zusi
+{
+	namespace text
+	{
+		//! Exponents written in plain notation
+		static const int PLAIN_MIN_EXPONENT = -5;
+		static const int PLAIN_MAX_EXPONENT = 9;
+
+		//! Significant digits which always identify a float
+		static const int MAX_DIGITS = 9;
+
+		//! Powers of ten, all exactly representable as double
+		static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17 };
+
+		size_t formatUint(char* dest, uint64_t value)
+		{
+			char digits[UINT_CHARS];
+			size_t count = 0;
+			do
+			{
+				digits[count++] = static_cast<char>('0' + value % 10);
+				value /= 10;
+			} while (value > 0);
+
+			for (size_t i = 0; i < count; ++i)
+				dest[i] = digits[count - 1 - i];
+			return count;
+		}
+
+		//! Shortest representation in exponent notation, for values outside the plain range
+		static size_t formatExponent(char* dest, float value)
+		{
+			char buffer[32];
+			for (int digits = 1; digits <= MAX_DIGITS; ++digits)
+			{
+				snprintf(buffer, sizeof(buffer), "%.*e", digits - 1, value);
+				if (strtof(buffer, nullptr) == value)
+					break;
+			}
+
+			size_t length = strlen(buffer);
+			memcpy(dest, buffer, length);
+			return length;
+		}
+
+		size_t formatFloat(char* dest, float value)
+		{
+			if (std::isnan(value))
+			{
+				memcpy(dest, "nan", 3);
+				return 3;
+			}
+
+			char* out = dest;
+			if (std::signbit(value))
+			{
+				if (value == 0.0f)
+				{
+					memcpy(dest, "-0", 2);
+					return 2;
+				}
+				*out++ = '-';
+			}
+
+			if (std::isinf(value))
+			{
+				memcpy(out, "inf", 3);
+				return out - dest + 3;
+			}
+
+			if (value == 0.0f)
+			{
+				*out = '0';
+				return 1;
+			}
+
+			float magnitude = std::fabs(value);
+			int exponent = static_cast<int>(std::floor(std::log10(static_cast<double>(magnitude))));
+			if (exponent < PLAIN_MIN_EXPONENT || exponent > PLAIN_MAX_EXPONENT)
+				return out - dest + formatExponent(out, magnitude);
+
+			//Find the fewest significant digits which round back to the same float
+			uint64_t mantissa = 0;
+			int decimals = 0;
+			for (int digits = 1; digits <= MAX_DIGITS; ++digits)
+			{
+				decimals = digits - 1 - exponent;
+				double scaled = decimals >= 0 ? magnitude * POW10[decimals] : magnitude / POW10[-decimals];
+				mantissa = static_cast<uint64_t>(std::llround(scaled));
+
+				double back = decimals >= 0 ? mantissa / POW10[decimals] : mantissa * POW10[-decimals];
+				if (static_cast<float>(back) == magnitude)
+					break;
+			}
+
+			char digits[UINT_CHARS];
+			size_t count = formatUint(digits, mantissa);
+
+			if (decimals <= 0)
+			{
+				memcpy(out, digits, count);
+				out += count;
+				for (int i = 0; i < -decimals; ++i)
+					*out++ = '0';
+				return out - dest;
+			}
+
+			//Drop trailing zeros of the fraction
+			while (decimals > 0 && digits[count - 1] == '0')
+			{
+				--count;
+				--decimals;
+			}
+
+			size_t fraction = static_cast<size_t>(decimals);
+			if (count > fraction)
+			{
+				memcpy(out, digits, count - fraction);
+				out += count - fraction;
+			}
+			else
+			{
+				*out++ = '0';
+			}
+
+			if (fraction > 0)
+			{
+				*out++ = '.';
+				for (size_t i = count; i < fraction; ++i)
+					*out++ = '0';
+				size_t shown = count < fraction ? count : fraction;
+				memcpy(out, digits + count - shown, shown);
+				out += shown;
+			}
+
+			return out - dest;
+		}
+	}
+}
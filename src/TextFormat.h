@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zusi
+{
+	//! Number formatting for text output of many values, without locales or stream state
+	namespace text
+	{
+		//! Space needed by formatFloat(), enough for any float
+		static const size_t FLOAT_CHARS = 24;
+
+		//! Space needed by formatUint(), enough for any uint64_t
+		static const size_t UINT_CHARS = 20;
+
+		/**
+		* @brief Write the shortest decimal representation which reads back as the same float
+		*
+		* Like std::to_chars(), which is not available before C++17, and unlike printf("%g"),
+		* no digits are lost and none are added.
+		* Values from 1e-5 to 1e9 are written in plain notation (12.5, 0.001), others
+		* in exponent notation (1.5e+12). Infinity and NaN are written as inf, -inf and nan.
+		* @param dest Buffer of at least FLOAT_CHARS characters; no terminator is written
+		* @return Number of characters written
+		*/
+		size_t formatFloat(char* dest, float value);
+
+		/**
+		* @brief Write an unsigned integer in decimal
+		* @param dest Buffer of at least UINT_CHARS characters; no terminator is written
+		* @return Number of characters written
+		*/
+		size_t formatUint(char* dest, uint64_t value);
+	}
+}
@@ -0,0 +1,705 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "UringSocket.h"
+#include "PosixBlockingSocket.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace zusi
+{
+	static const uint64_t TAG_RECV = 1;
+	static const uint64_t TAG_SEND = 2;
+	static const uint16_t BUFFER_GROUP = 0;
+	static const unsigned RING_ENTRIES = 16;
+
+	static int uringSetup(unsigned entries, io_uring_params* p)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+	}
+
+	static int uringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+	}
+
+	static int uringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+	}
+
+	template<typename T> static T loadAcquire(const T* p)
+	{
+		return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+	}
+
+	template<typename T> static void storeRelease(T* p, T v)
+	{
+		__atomic_store_n(p, v, __ATOMIC_RELEASE);
+	}
+
+	//! Memory-mapped submission and completion queues plus the provided buffer ring
+	struct UringSocket::Ring
+	{
+		Ring() : fd(-1), sqpoll(false), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), buf_ring(MAP_FAILED), to_submit(0)
+		{
+		}
+
+		~Ring()
+		{
+			if (buf_ring != MAP_FAILED)
+				munmap(buf_ring, buf_ring_bytes);
+			if (sqes != MAP_FAILED)
+				munmap(sqes, sqes_bytes);
+			if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+				munmap(cq_ptr, cq_bytes);
+			if (sq_ptr != MAP_FAILED)
+				munmap(sq_ptr, sq_bytes);
+			if (fd >= 0)
+				close(fd);
+		}
+
+		//! Create the ring, returns false if the kernel refuses
+		bool create(bool use_sqpoll, unsigned idle_ms)
+		{
+			io_uring_params p;
+			memset(&p, 0, sizeof(p));
+			if (use_sqpoll)
+			{
+				p.flags = IORING_SETUP_SQPOLL;
+				p.sq_thread_idle = idle_ms;
+			}
+
+			fd = uringSetup(RING_ENTRIES, &p);
+			if (fd < 0)
+				return false;
+			sqpoll = use_sqpoll;
+
+			sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+			if (p.features & IORING_FEAT_SINGLE_MMAP)
+				sq_bytes = cq_bytes = (sq_bytes > cq_bytes ? sq_bytes : cq_bytes);
+
+			sq_ptr = mmap(nullptr, sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sq_ptr == MAP_FAILED)
+				return false;
+
+			if (p.features & IORING_FEAT_SINGLE_MMAP)
+				cq_ptr = sq_ptr;
+			else
+			{
+				cq_ptr = mmap(nullptr, cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+				if (cq_ptr == MAP_FAILED)
+					return false;
+			}
+
+			sqes_bytes = p.sq_entries * sizeof(io_uring_sqe);
+			sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+			if (sqes == MAP_FAILED)
+				return false;
+
+			char* sq = static_cast<char*>(sq_ptr);
+			sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+			sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+			sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+			sq_entries = p.sq_entries;
+			sq_flags = reinterpret_cast<unsigned*>(sq + p.sq_off.flags);
+			sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+			char* cq = static_cast<char*>(cq_ptr);
+			cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+			cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+			cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+			return true;
+		}
+
+		//! Register a provided buffer ring with the given number of entries
+		bool registerBufferRing(unsigned entries)
+		{
+			buf_ring_bytes = entries * sizeof(io_uring_buf);
+			buf_ring = mmap(nullptr, buf_ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (buf_ring == MAP_FAILED)
+				return false;
+
+			buf_mask = entries - 1;
+			buf_tail = 0;
+
+			io_uring_buf_reg reg;
+			memset(&reg, 0, sizeof(reg));
+			reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+			reg.ring_entries = entries;
+			reg.bgid = BUFFER_GROUP;
+			return uringRegister(fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+		}
+
+		//! Queue a buffer for the kernel to receive into, made visible by publishBuffers()
+		void addBuffer(void* addr, unsigned len, uint16_t bid)
+		{
+			io_uring_buf* buf = static_cast<io_uring_buf*>(buf_ring) + (buf_tail & buf_mask);
+			buf->addr = reinterpret_cast<uint64_t>(addr);
+			buf->len = len;
+			buf->bid = bid;
+			++buf_tail;
+		}
+
+		void publishBuffers()
+		{
+			//The ring tail overlays the reserved field of the first entry
+			uint16_t* tail = reinterpret_cast<uint16_t*>(static_cast<char*>(buf_ring) + 14);
+			storeRelease(tail, buf_tail);
+		}
+
+		//! Get a free submission entry, or null if the queue is full
+		io_uring_sqe* getSqe()
+		{
+			unsigned tail = *sq_tail;
+			if (tail - loadAcquire(sq_head) >= sq_entries)
+				return nullptr;
+
+			io_uring_sqe* sqe = &sqes[tail & sq_mask];
+			memset(sqe, 0, sizeof(*sqe));
+			sq_array[tail & sq_mask] = tail & sq_mask;
+			storeRelease(sq_tail, tail + 1);
+			++to_submit;
+			return sqe;
+		}
+
+		//! Make queued entries visible to the kernel, only enters the kernel if needed
+		void submit()
+		{
+			if (to_submit == 0)
+				return;
+
+			if (sqpoll)
+			{
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+				if (loadAcquire(sq_flags) & IORING_SQ_NEED_WAKEUP)
+					uringEnter(fd, to_submit, 0, IORING_ENTER_SQ_WAKEUP);
+			}
+			else
+				uringEnter(fd, to_submit, 0, 0);
+
+			to_submit = 0;
+		}
+
+		//! Next completion or null, does not block
+		io_uring_cqe* peekCqe()
+		{
+			unsigned head = *cq_head;
+			if (head == loadAcquire(cq_tail))
+				return nullptr;
+			return &cqes[head & cq_mask];
+		}
+
+		//! Block until at least one completion is available
+		void waitCqe()
+		{
+			unsigned submit_count = sqpoll ? 0 : to_submit;
+			to_submit = 0;
+			uringEnter(fd, submit_count, 1, IORING_ENTER_GETEVENTS);
+		}
+
+		void seenCqe()
+		{
+			storeRelease(cq_head, *cq_head + 1);
+		}
+
+		int fd;
+		bool sqpoll;
+
+		void* sq_ptr;
+		size_t sq_bytes;
+		void* cq_ptr;
+		size_t cq_bytes;
+		io_uring_sqe* sqes;
+		size_t sqes_bytes;
+
+		unsigned* sq_head;
+		unsigned* sq_tail;
+		unsigned* sq_flags;
+		unsigned* sq_array;
+		unsigned sq_mask;
+		unsigned sq_entries;
+
+		unsigned* cq_head;
+		unsigned* cq_tail;
+		unsigned cq_mask;
+		io_uring_cqe* cqes;
+
+		void* buf_ring;
+		size_t buf_ring_bytes;
+		unsigned buf_mask;
+		uint16_t buf_tail;
+
+		unsigned to_submit;
+	};
+
+	//! Received data in one of the registered buffers
+	struct UringSocket::Chunk
+	{
+		uint16_t buffer_id;
+		unsigned offset;
+		unsigned bytes;
+	};
+
+	UringSocket::UringSocket(const char* ip_address, int port, const Options& options) : m_recvMemory(static_cast<char*>(MAP_FAILED))
+	{
+		m_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+		if (m_socket < 0)
+			throw std::runtime_error("Socket error - Socket creation Failed!");
+
+		sockaddr_in sock_addr = {};
+		sock_addr.sin_port = htons(port);
+		sock_addr.sin_family = AF_INET;
+		inet_pton(AF_INET, ip_address, &(sock_addr.sin_addr));
+
+		if (::connect(m_socket, reinterpret_cast<sockaddr*>(&sock_addr), sizeof(sock_addr)) != 0)
+		{
+			close(m_socket);
+			throw std::runtime_error("Failed to establish connection with server");
+		}
+
+		try
+		{
+			init(options);
+		}
+		catch (...)
+		{
+			close(m_socket);
+			throw;
+		}
+	}
+
+	UringSocket::UringSocket(int socket, const Options& options) : m_socket(socket), m_recvMemory(static_cast<char*>(MAP_FAILED))
+	{
+		init(options);
+	}
+
+	void UringSocket::init(const Options& options)
+	{
+		if (options.recv_buffers == 0 || (options.recv_buffers & (options.recv_buffers - 1)) != 0 || options.recv_buffers > 32768)
+			throw std::runtime_error("io_uring error - number of receive buffers must be a power of two");
+
+		//Each message is sent as a whole, so Nagle's algorithm only adds delay
+		int flag = 1;
+		setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+		m_ring.reset(new Ring());
+		if (!m_ring->create(options.sqpoll, options.sqpoll_idle_ms))
+		{
+			//Polling thread may be restricted, try without
+			m_ring.reset(new Ring());
+			if (!options.sqpoll || !m_ring->create(false, 0))
+				throw std::runtime_error("io_uring error - ring creation failed");
+		}
+
+		m_recvBuffers = options.recv_buffers;
+		m_recvBufferBytes = options.recv_buffer_bytes;
+		m_recvMemoryBytes = static_cast<size_t>(m_recvBuffers) * m_recvBufferBytes;
+		m_recvMemory = static_cast<char*>(mmap(nullptr, m_recvMemoryBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0));
+		if (m_recvMemory == MAP_FAILED)
+			throw std::runtime_error("io_uring error - receive buffer allocation failed");
+
+		if (!m_ring->registerBufferRing(m_recvBuffers))
+		{
+			munmap(m_recvMemory, m_recvMemoryBytes);
+			m_recvMemory = static_cast<char*>(MAP_FAILED);
+			throw std::runtime_error("io_uring error - buffer ring registration failed");
+		}
+
+		for (unsigned i = 0; i < m_recvBuffers; ++i)
+			m_ring->addBuffer(m_recvMemory + static_cast<size_t>(i) * m_recvBufferBytes, m_recvBufferBytes, static_cast<uint16_t>(i));
+		m_ring->publishBuffers();
+
+		m_chunks.reset(new Chunk[m_recvBuffers]);
+		m_chunkHead = 0;
+		m_chunkCount = 0;
+		m_recvArmed = false;
+		m_eof = false;
+
+		m_sendBufferBytes = options.send_buffer_bytes;
+		m_sendMemory.reset(new char[2 * static_cast<size_t>(m_sendBufferBytes)]);
+		m_fill = m_sendMemory.get();
+		m_fillBytes = 0;
+		m_inFlight = m_fill + m_sendBufferBytes;
+		m_inFlightBytes = 0;
+		m_inFlightSent = 0;
+		m_sending = false;
+
+		m_error = false;
+
+		armReceive();
+		m_ring->submit();
+	}
+
+	UringSocket::~UringSocket()
+	{
+		//Terminate outstanding operations before the buffers go away
+		Flush();
+		shutdown(m_socket, SHUT_RDWR);
+		while ((m_recvArmed || m_sending) && processCompletions(true));
+
+		m_ring.reset();
+		if (m_recvMemory != MAP_FAILED)
+			munmap(m_recvMemory, m_recvMemoryBytes);
+		close(m_socket);
+	}
+
+	void UringSocket::armReceive()
+	{
+		io_uring_sqe* sqe = m_ring->getSqe();
+		if (!sqe)
+			return;
+
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = m_socket;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = BUFFER_GROUP;
+		sqe->user_data = TAG_RECV;
+		m_recvArmed = true;
+	}
+
+	void UringSocket::submitSend()
+	{
+		io_uring_sqe* sqe = m_ring->getSqe();
+		if (!sqe)
+		{
+			//Queue is only full of completed entries the kernel has not consumed yet
+			m_ring->submit();
+			while (!(sqe = m_ring->getSqe()))
+				processCompletions(true);
+		}
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = m_socket;
+		sqe->addr = reinterpret_cast<uint64_t>(m_inFlight + m_inFlightSent);
+		sqe->len = static_cast<uint32_t>(m_inFlightBytes - m_inFlightSent);
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->user_data = TAG_SEND;
+		m_sending = true;
+
+		m_ring->submit();
+	}
+
+	bool UringSocket::processCompletions(bool wait)
+	{
+		io_uring_cqe* cqe = m_ring->peekCqe();
+		if (!cqe)
+		{
+			if (!wait)
+				return false;
+
+			m_ring->waitCqe();
+			cqe = m_ring->peekCqe();
+			if (!cqe)
+				return !m_error;
+		}
+
+		for (; cqe; cqe = m_ring->peekCqe())
+		{
+			uint64_t tag = cqe->user_data;
+			int res = cqe->res;
+			unsigned flags = cqe->flags;
+			m_ring->seenCqe();
+
+			if (tag == TAG_RECV)
+			{
+				if (res > 0 && (flags & IORING_CQE_F_BUFFER))
+				{
+					Chunk& chunk = m_chunks[(m_chunkHead + m_chunkCount) % m_recvBuffers];
+					chunk.buffer_id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+					chunk.offset = 0;
+					chunk.bytes = static_cast<unsigned>(res);
+					++m_chunkCount;
+				}
+				else if (res == 0)
+					m_eof = true;
+				else if (res < 0 && res != -ENOBUFS)
+					m_error = true;
+
+				if (!(flags & IORING_CQE_F_MORE))
+				{
+					m_recvArmed = false;
+					//Out of buffers - re-armed once the reader returns some
+					if (res > 0 && !m_eof && !m_error)
+						armReceive();
+				}
+			}
+			else if (tag == TAG_SEND)
+			{
+				if (res < 0)
+				{
+					m_error = true;
+					m_sending = false;
+				}
+				else
+				{
+					m_inFlightSent += static_cast<size_t>(res);
+					if (m_inFlightSent < m_inFlightBytes && res > 0)
+						submitSend();
+					else
+					{
+						if (m_inFlightSent < m_inFlightBytes)
+							m_error = true;
+						m_sending = false;
+					}
+				}
+			}
+		}
+
+		m_ring->submit();
+		return !m_error;
+	}
+
+	void UringSocket::recycle(uint16_t buffer_id)
+	{
+		m_ring->addBuffer(m_recvMemory + static_cast<size_t>(buffer_id) * m_recvBufferBytes, m_recvBufferBytes, buffer_id);
+		m_ring->publishBuffers();
+	}
+
+	int UringSocket::ReadBytes(void* dest, int bytes)
+	{
+		char* dest_chars = static_cast<char*>(dest);
+		int read = 0;
+
+		//Anything queued must reach the peer before we wait for its answer
+		Flush();
+
+		while (read < bytes)
+		{
+			if (m_chunkCount == 0)
+			{
+				if (m_eof || m_error)
+					break;
+
+				if (!m_recvArmed)
+				{
+					armReceive();
+					m_ring->submit();
+				}
+
+				processCompletions(true);
+				continue;
+			}
+
+			Chunk& chunk = m_chunks[m_chunkHead];
+			unsigned count = chunk.bytes - chunk.offset;
+			if (count > static_cast<unsigned>(bytes - read))
+				count = static_cast<unsigned>(bytes - read);
+
+			memcpy(dest_chars + read, m_recvMemory + static_cast<size_t>(chunk.buffer_id) * m_recvBufferBytes + chunk.offset, count);
+			chunk.offset += count;
+			read += count;
+
+			if (chunk.offset == chunk.bytes)
+			{
+				recycle(chunk.buffer_id);
+				m_chunkHead = (m_chunkHead + 1) % m_recvBuffers;
+				--m_chunkCount;
+			}
+		}
+
+		if (read == 0 && m_error)
+			return -1;
+		return read;
+	}
+
+	int UringSocket::WriteBytes(const void* src, int bytes)
+	{
+		if (m_error)
+			return -1;
+
+		const char* src_chars = static_cast<const char*>(src);
+		size_t remaining = static_cast<size_t>(bytes);
+
+		while (remaining > 0)
+		{
+			if (m_fillBytes == m_sendBufferBytes && !Flush())
+				return -1;
+
+			size_t count = m_sendBufferBytes - m_fillBytes;
+			if (count > remaining)
+				count = remaining;
+
+			memcpy(m_fill + m_fillBytes, src_chars, count);
+			m_fillBytes += count;
+			src_chars += count;
+			remaining -= count;
+		}
+
+		return bytes;
+	}
+
+	bool UringSocket::DataToRead()
+	{
+		if (m_chunkCount == 0)
+			processCompletions(false);
+		return m_chunkCount > 0;
+	}
+
+	int UringSocket::BytesAvailable()
+	{
+		if (m_chunkCount == 0)
+			processCompletions(false);
+
+		if (m_chunkCount == 0)
+		{
+			if (m_eof || m_error)
+				return -1;
+
+			if (!m_recvArmed)
+			{
+				armReceive();
+				m_ring->submit();
+			}
+			return 0;
+		}
+
+		int available = 0;
+		for (unsigned i = 0; i < m_chunkCount; ++i)
+		{
+			const Chunk& chunk = m_chunks[(m_chunkHead + i) % m_recvBuffers];
+			available += chunk.bytes - chunk.offset;
+		}
+		return available;
+	}
+
+	bool UringSocket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		//Blocking receives wait until time_point::max(), which must not overflow
+		auto start = std::chrono::steady_clock::now();
+		auto deadline = timeout >= std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::time_point::max() - start) ?
+			std::chrono::steady_clock::time_point::max() : start + timeout;
+
+		//Anything queued must reach the peer before we wait for its answer
+		Flush();
+
+		while (BytesAvailable() == 0)
+		{
+			auto now = std::chrono::steady_clock::now();
+			if (now >= deadline)
+				return false;
+
+			int64_t remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+			timespec ts;
+			ts.tv_sec = static_cast<time_t>(remaining / 1000000000);
+			ts.tv_nsec = static_cast<long>(remaining % 1000000000);
+
+			//The ring's descriptor becomes readable when completions are waiting
+			pollfd pfd = {};
+			pfd.fd = m_ring->fd;
+			pfd.events = POLLIN;
+			if (ppoll(&pfd, 1, &ts, nullptr) < 0 && errno != EINTR)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool UringSocket::Flush()
+	{
+		//Only one send in flight, so data cannot be reordered by a short send
+		while (m_sending && processCompletions(true));
+
+		if (m_error)
+			return false;
+		if (m_fillBytes == 0)
+			return true;
+
+		char* sent = m_inFlight;
+		m_inFlight = m_fill;
+		m_inFlightBytes = m_fillBytes;
+		m_inFlightSent = 0;
+		m_fill = sent;
+		m_fillBytes = 0;
+
+		submitSend();
+		return !m_error;
+	}
+
+	bool UringSocket::isSupported()
+	{
+		//Probed once, thread-safe as a function-local static
+		static const bool supported = []() {
+			//Multishot receive was added in 6.0
+			utsname name;
+			int major = 0, minor = 0;
+			if (uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6)
+				return false;
+
+			Ring ring;
+			if (!ring.create(false, 0))
+				return false;
+
+			//Probe the opcodes used
+			const unsigned probe_ops = 256;
+			std::unique_ptr<char[]> probe_memory(new char[sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op)]());
+			io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_memory.get());
+			if (uringRegister(ring.fd, IORING_REGISTER_PROBE, probe, probe_ops) != 0)
+				return false;
+			if (probe->last_op < IORING_OP_SEND || probe->last_op < IORING_OP_RECV)
+				return false;
+			if (!(probe->ops[IORING_OP_SEND].flags & IO_URING_OP_SUPPORTED) || !(probe->ops[IORING_OP_RECV].flags & IO_URING_OP_SUPPORTED))
+				return false;
+
+			return ring.registerBufferRing(1);
+		}();
+
+		return supported;
+	}
+
+	std::unique_ptr<Socket> UringSocket::createSocket(const char* ip_address, int port, const Options& options)
+	{
+		if (isSupported())
+		{
+			try
+			{
+				return std::unique_ptr<Socket>(new UringSocket(ip_address, port, options));
+			}
+			catch (std::runtime_error&)
+			{
+				//Fall through - e.g. ring limits reached
+			}
+		}
+
+		return std::unique_ptr<Socket>(new PosixBlockingSocket(ip_address, port));
+	}
+
+}
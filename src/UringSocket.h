@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2016 Jonathan Pilborough
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "Zusi3TCP.h"
+
+#include <memory>
+
+namespace zusi
+{
+
+	/**
+	* @brief Socket implemented with Linux io_uring
+	*
+	* Receiving uses a single multishot receive operation, which places incoming
+	* data into a ring of buffers registered with the kernel. Outgoing data is
+	* collected in a send buffer and submitted as one operation per Flush(), i.e.
+	* per message. With the submission queue polling thread enabled (the default)
+	* submitting a send needs no system call while the kernel thread is awake.
+	*
+	* Requires Linux 6.0 or later. Use isSupported() or createSocket() to fall back
+	* to PosixBlockingSocket on older kernels or where io_uring is disabled.
+	*
+	* The socket must only be used from one thread at a time.
+	*/
+	class UringSocket :
+		public zusi::Socket
+	{
+	public:
+
+		//! Tuning options
+		struct Options
+		{
+			Options() : sqpoll(true), sqpoll_idle_ms(100), recv_buffers(64), recv_buffer_bytes(16 * 1024), send_buffer_bytes(64 * 1024)
+			{
+			}
+
+			//! Use a kernel thread to poll the submission queue
+			bool sqpoll;
+			//! Idle time after which the polling thread sleeps
+			unsigned sqpoll_idle_ms;
+			//! Number of receive buffers, must be a power of two
+			unsigned recv_buffers;
+			//! Size of each receive buffer
+			unsigned recv_buffer_bytes;
+			//! Size of each of the two send buffers
+			unsigned send_buffer_bytes;
+		};
+
+		/**
+		* @brief Construct a new socket and initiate a TCP connection
+		* @param ip_address Null-terminated string of IP Address to connect to
+		* @param port Port to connection to, usually 1436.
+		* @param options Tuning options
+		* @throws std::runtime_error system error when creating socket or ring
+		*/
+		UringSocket(const char* ip_address, int port, const Options& options = Options());
+
+		/**
+		* @brief Construct a new socket using an existing socket handle
+		*
+		* The class will handle clean-up of the socket once constructed. If the
+		* constructor throws, the caller keeps ownership, e.g. to fall back to
+		* PosixBlockingSocket.
+		*
+		* @param socket File descriptor of a connected socket
+		* @param options Tuning options
+		* @throws std::runtime_error system error when creating the ring
+		*/
+		UringSocket(int socket, const Options& options = Options());
+
+		virtual ~UringSocket();
+
+		virtual int ReadBytes(void* dest, int bytes);
+		virtual int WriteBytes(const void* src, int bytes);
+		virtual bool DataToRead();
+		virtual int BytesAvailable();
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
+		virtual bool Flush();
+
+		//! Check whether the running kernel supports the features used by this class
+		static bool isSupported();
+
+		/**
+		* @brief Connect using UringSocket if supported, otherwise PosixBlockingSocket
+		* @param ip_address Null-terminated string of IP Address to connect to
+		* @param port Port to connection to, usually 1436.
+		* @param options Tuning options for UringSocket
+		* @throws std::runtime_error system error when creating socket
+		*/
+		static std::unique_ptr<Socket> createSocket(const char* ip_address, int port, const Options& options = Options());
+
+	private:
+		struct Ring;
+		struct Chunk;
+
+		UringSocket(const UringSocket& other);
+
+		void init(const Options& options);
+		void armReceive();
+		void submitSend();
+		bool processCompletions(bool wait);
+		void recycle(uint16_t buffer_id);
+
+		int m_socket;
+		std::unique_ptr<Ring> m_ring;
+
+		//Receive buffers and chunks waiting to be read
+		char* m_recvMemory;
+		size_t m_recvMemoryBytes;
+		unsigned m_recvBuffers;
+		unsigned m_recvBufferBytes;
+		std::unique_ptr<Chunk[]> m_chunks;
+		unsigned m_chunkHead;
+		unsigned m_chunkCount;
+		bool m_recvArmed;
+		bool m_eof;
+
+		//Double-buffered send: one buffer being filled, one in flight
+		std::unique_ptr<char[]> m_sendMemory;
+		unsigned m_sendBufferBytes;
+		char* m_fill;
+		size_t m_fillBytes;
+		char* m_inFlight;
+		size_t m_inFlightBytes;
+		size_t m_inFlightSent;
+		bool m_sending;
+
+		bool m_error;
+	};
+
+}
@@ -104,5 +104,47 @@ namespace zusi
 			return false;
 		return bytes_available > 0;
 	}
+
+	int WinsockBlockingSocket::BytesAvailable()
+	{
+		unsigned long bytes_available;
+		if (ioctlsocket(m_socket, FIONREAD, &bytes_available) != 0)
+			return -1;
+		if (bytes_available > 0)
+			return static_cast<int>(bytes_available);
+
+		if (!WaitReadable(std::chrono::microseconds(0)))
+			return 0;
+
+		//Readable with nothing buffered means the stream has ended, unless data arrived in between
+		if (ioctlsocket(m_socket, FIONREAD, &bytes_available) != 0 || bytes_available == 0)
+			return -1;
+		return static_cast<int>(bytes_available);
+	}
+
+	bool WinsockBlockingSocket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		//timeval holds a long, so very long waits are done a day at a time
+		const long long max_us = 24LL * 3600 * 1000000;
+		long long remaining = timeout.count();
+
+		while (true)
+		{
+			long long us = remaining < max_us ? remaining : max_us;
+
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET(m_socket, &readable);
+
+			timeval tv;
+			tv.tv_sec = static_cast<long>(us / 1000000);
+			tv.tv_usec = static_cast<long>(us % 1000000);
+
+			int result = select(0, &readable, nullptr, nullptr, &tv);
+			if (result != 0 || remaining <= max_us)
+				return result > 0;
+			remaining -= max_us;
+		}
+	}
 }
 
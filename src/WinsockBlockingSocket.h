@@ -59,6 +59,8 @@ namespace zusi
 		virtual int ReadBytes(void* dest, int bytes);
 		virtual int WriteBytes(const void* src, int bytes);
 		virtual bool DataToRead();
+		virtual int BytesAvailable();
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
 
 	private:
 
@@ -21,12 +21,33 @@ SOFTWARE.
 */
 
 #include "Zusi3TCP.h"
+#include "BufferSocket.h"
+#include "FrameBuffer.h"
+#include "FrameReader.h"
+#include "StateFrame.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <thread>
 
 namespace zusi
 {
+	const uint32_t Node::NODE_START;
+	const uint32_t Node::NODE_END;
+
+	bool Socket::WaitReadable(std::chrono::microseconds timeout)
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!DataToRead())
+		{
+			if (std::chrono::steady_clock::now() >= deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		return true;
+	}
+
 	void Attribute::write(Socket& sock) const
 	{
 		uint32_t length = data_bytes + sizeof(m_id);
@@ -38,11 +59,14 @@ namespace zusi
 	bool Attribute::read(Socket& sock, uint32_t length)
 	{
 		data_bytes = length - sizeof(m_id);
-		sock.ReadBytes(&m_id, sizeof(m_id));
+		if (sock.ReadBytes(&m_id, sizeof(m_id)) != sizeof(m_id))
+		{
+			data_bytes = 0;
+			return false;
+		}
 		data = operator new(data_bytes);
-		sock.ReadBytes(data, data_bytes);
 
-		return true;
+		return sock.ReadBytes(data, data_bytes) == static_cast<int>(data_bytes);
 	}
 
 	bool Node::write(Socket& sock) const
@@ -62,56 +86,353 @@ namespace zusi
 		return true;
 	}
 
-	bool Node::read(Socket& sock)
+	void Node::buildIndex(bool recursive)
+	{
+		m_index.clear();
+		m_indexedAttributes = 0;
+
+		//Positions are stored in 16 bits
+		if (attributes.size() + nodes.size() > INDEX_MIN_ITEMS && attributes.size() <= 0x10000 && nodes.size() <= 0x10000)
+		{
+			m_index.reserve(attributes.size() + nodes.size());
+			for (size_t i = 0; i < attributes.size(); ++i)
+				m_index.push_back(static_cast<uint32_t>(attributes[i]->getId()) << 16 | static_cast<uint32_t>(i));
+			for (size_t i = 0; i < nodes.size(); ++i)
+				m_index.push_back(static_cast<uint32_t>(nodes[i]->getId()) << 16 | static_cast<uint32_t>(i));
+
+			m_indexedAttributes = attributes.size();
+			std::sort(m_index.begin(), m_index.begin() + m_indexedAttributes);
+			std::sort(m_index.begin() + m_indexedAttributes, m_index.end());
+		}
+
+		if (recursive)
+			for (Node* n_p : nodes)
+				n_p->buildIndex(true);
+	}
+
+	bool Node::indexed() const
+	{
+		return !m_index.empty() && m_indexedAttributes == attributes.size() && m_index.size() - m_indexedAttributes == nodes.size();
+	}
+
+	IdRange<Attribute> Node::equalRangeAttributes(uint16_t id) const
+	{
+		if (!indexed())
+			return IdRange<Attribute>(attributes, id);
+
+		const uint32_t* first = m_index.data();
+		const uint32_t* last = first + m_indexedAttributes;
+		return IdRange<Attribute>(attributes, std::lower_bound(first, last, static_cast<uint32_t>(id) << 16),
+			std::upper_bound(first, last, static_cast<uint32_t>(id) << 16 | 0xFFFF), id);
+	}
+
+	IdRange<Node> Node::equalRangeNodes(uint16_t id) const
+	{
+		if (!indexed())
+			return IdRange<Node>(nodes, id);
+
+		const uint32_t* first = m_index.data() + m_indexedAttributes;
+		const uint32_t* last = m_index.data() + m_index.size();
+		return IdRange<Node>(nodes, std::lower_bound(first, last, static_cast<uint32_t>(id) << 16),
+			std::upper_bound(first, last, static_cast<uint32_t>(id) << 16 | 0xFFFF), id);
+	}
+
+	Attribute* Node::findAttribute(uint16_t id) const
 	{
-		sock.ReadBytes(&m_id, sizeof(m_id));
+		IdRange<Attribute> found = equalRangeAttributes(id);
+		return found.empty() ? nullptr : *found.begin();
+	}
+
+	Node* Node::findNode(uint16_t id) const
+	{
+		IdRange<Node> found = equalRangeNodes(id);
+		return found.empty() ? nullptr : *found.begin();
+	}
+
+	FrameWriter::FrameWriter() : m_depth(0)
+	{
+	}
+
+	void FrameWriter::beginNode(uint16_t id)
+	{
+		size_t pos = m_buffer.size();
+		m_buffer.resize(pos + sizeof(Node::NODE_START) + sizeof(id));
+		memcpy(&m_buffer[pos], &Node::NODE_START, sizeof(Node::NODE_START));
+		memcpy(&m_buffer[pos + sizeof(Node::NODE_START)], &id, sizeof(id));
+		++m_depth;
+	}
+
+	void FrameWriter::endNode()
+	{
+		if (m_depth == 0)
+			throw std::runtime_error("Encoding error - endNode() without open node");
+
+		size_t pos = m_buffer.size();
+		m_buffer.resize(pos + sizeof(Node::NODE_END));
+		memcpy(&m_buffer[pos], &Node::NODE_END, sizeof(Node::NODE_END));
+		--m_depth;
+	}
+
+	void FrameWriter::attribute(uint16_t id, const void* data, size_t bytes)
+	{
+		if (m_depth == 0)
+			throw std::runtime_error("Encoding error - attribute outside of a node");
+
+		uint32_t length = static_cast<uint32_t>(bytes + sizeof(id));
+		size_t pos = m_buffer.size();
+		m_buffer.resize(pos + sizeof(length) + length);
+		memcpy(&m_buffer[pos], &length, sizeof(length));
+		memcpy(&m_buffer[pos + sizeof(length)], &id, sizeof(id));
+		if (bytes > 0)
+			memcpy(&m_buffer[pos + sizeof(length) + sizeof(id)], data, bytes);
+	}
+
+	void FrameWriter::node(const Node& node)
+	{
+		beginNode(node.getId());
+		for (const Attribute* att : node.attributes)
+			attribute(att->getId(), att->data, att->data_bytes);
+		for (const Node* sub : node.nodes)
+			this->node(*sub);
+		endNode();
+	}
+
+	void FrameWriter::append(const void* data, size_t bytes)
+	{
+		if (bytes == 0)
+			return;
+
+		size_t pos = m_buffer.size();
+		m_buffer.resize(pos + bytes);
+		memcpy(&m_buffer[pos], data, bytes);
+	}
+
+	void FrameWriter::clear()
+	{
+		m_buffer.clear();
+		m_depth = 0;
+	}
+
+	bool Node::read(Socket& sock, bool index)
+	{
+		if (sock.ReadBytes(&m_id, sizeof(m_id)) != sizeof(m_id))
+			return false;
 
 		uint32_t next_length;
 		while (true)
 		{
-			sock.ReadBytes(&next_length, sizeof(next_length));
+			//Stream ended in the middle of the message
+			if (sock.ReadBytes(&next_length, sizeof(next_length)) != sizeof(next_length))
+				return false;
 
 			if (next_length == NODE_START)
 			{
 				Node* new_node = new Node();
-				new_node->read(sock);
 				nodes.push_back(new_node);
+				if (!new_node->read(sock, index))
+					return false;
 			}
 			else if (next_length == NODE_END)
 			{
+				if (index)
+					buildIndex(false);
 				return true;
 			}
 			else
 			{
 				Attribute* new_attribute = new Attribute();
-				new_attribute->read(sock, next_length);
 				attributes.push_back(new_attribute);
+				if (next_length < sizeof(uint16_t) || !new_attribute->read(sock, next_length))
+					return false;
 			}
 		}
 	}
 	
+	Connection::Connection(Socket* socket) : m_socket(socket), m_frameBytes(0)
+	{
+	}
+
+	Connection::~Connection()
+	{
+	}
+
 	bool Connection::receiveMessage(Node& dest) const
 	{
+		//Finish a message partly received by a timed call
+		if (m_received && m_received->size() > 0)
+			return receiveMessage(dest, std::chrono::steady_clock::time_point::max()) == Receive_Message;
+
 		uint32_t header;
-		m_socket->ReadBytes(&header, sizeof(header));
+		if (m_socket->ReadBytes(&header, sizeof(header)) != sizeof(header))
+			return false;
 		if (header != 0)
 			return false;
 
 		return dest.read(*m_socket);
 	}
 
+	Connection::ReceiveStatus Connection::receiveMessage(Node& dest, std::chrono::steady_clock::time_point deadline) const
+	{
+		ReceiveStatus status = nextFrame(deadline);
+		if (status != Receive_Message)
+			return status;
+
+		//Skip the message header, Node::read() expects the ID next
+		BufferSocket sock(m_received->data() + sizeof(uint32_t), m_frameBytes - sizeof(uint32_t));
+		bool decoded = dest.read(sock);
+
+		m_received->consume(m_frameBytes);
+		m_frameBytes = 0;
+		if (!decoded)
+			throw std::runtime_error("Protocol error - invalid message");
+		return Receive_Message;
+	}
+
+	bool Connection::receiveFrame(FrameReader& dest) const
+	{
+		return receiveFrame(dest, std::chrono::steady_clock::time_point::max()) == Receive_Message;
+	}
+
+	Connection::ReceiveStatus Connection::receiveFrame(FrameReader& dest, std::chrono::steady_clock::time_point deadline) const
+	{
+		ReceiveStatus status = nextFrame(deadline);
+		if (status == Receive_Message)
+			dest = FrameReader(m_received->data(), m_frameBytes);
+		return status;
+	}
+
+	Connection::ReceiveStatus Connection::nextFrame(std::chrono::steady_clock::time_point deadline) const
+	{
+		if (!m_received)
+			m_received.reset(new FrameBuffer());
+
+		//The message handed out by receiveFrame() is no longer needed
+		if (m_frameBytes > 0)
+		{
+			m_received->consume(m_frameBytes);
+			m_frameBytes = 0;
+		}
+
+		while ((m_frameBytes = m_received->frameLength()) == 0)
+		{
+			int available = m_socket->BytesAvailable();
+			if (available == 0)
+			{
+				auto now = std::chrono::steady_clock::now();
+				std::chrono::microseconds timeout(0);
+				if (deadline > now)
+					timeout = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+
+				if (!m_socket->WaitReadable(timeout))
+					return Receive_Timeout;
+				available = m_socket->BytesAvailable();
+			}
+
+			//Readable but nothing to read means the stream has ended
+			if (available <= 0)
+				return Receive_Closed;
+
+			int received = m_socket->ReadBytes(m_received->prepare(available), available);
+			if (received <= 0)
+				return Receive_Closed;
+			m_received->commit(received);
+		}
+
+		return Receive_Message;
+	}
+
+	FrameWriter& Connection::encoder()
+	{
+		static thread_local FrameWriter writer;
+		writer.clear();
+		return writer;
+	}
+
 	bool Connection::sendMessage(Node& src)
 	{
-		return src.write(*m_socket);
+		if (!src.write(*m_socket))
+			return false;
+
+		return m_socket->Flush();
+	}
+
+	bool Connection::sendMessage(const FrameWriter& src)
+	{
+		if (src.depth() != 0)
+			throw std::runtime_error("Encoding error - message has unterminated nodes");
+
+		return sendFrame(src.data(), src.size());
+	}
+
+	bool Connection::sendFrame(const void* frame, size_t bytes)
+	{
+		int length = static_cast<int>(bytes);
+		if (m_socket->WriteBytes(frame, length) != length)
+			return false;
+
+		return m_socket->Flush();
+	}
+
+	bool Connection::sendMessages(const std::vector<const Node*>& messages)
+	{
+		FrameWriter& writer = encoder();
+		for (const Node* msg : messages)
+			writer.node(*msg);
+
+		return sendMessage(writer);
+	}
+
+	bool ClientConnection::connect(const char* client_id, const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung, bool pipelined)
+	{
+		Node needed_data_msg(MsgType_Fahrpult);
+		needed_data_msg.nodes.push_back(buildNeededData(fs_data, prog_data, bedienung));
+
+		FrameWriter needed_data;
+		needed_data.node(needed_data_msg);
+		return connect(client_id, needed_data.data(), needed_data.size(), pipelined);
 	}
 
-	bool ClientConnection::connect(const char* client_id, const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung)
+	bool ClientConnection::connect(const char* client_id, const void* needed_data, size_t bytes, bool pipelined)
 	{
-		//Send hello
-		Node hello_message(1);
+		Node hello_message(MsgType_Connecting);
+		hello_message.nodes.push_back(buildHello(client_id));
 
-		zusi::Node* hello = new zusi::Node(1);
-		hello_message.nodes.push_back(hello);
+		FrameWriter& writer = encoder();
+		writer.node(hello_message);
+		if (pipelined)
+			writer.append(needed_data, bytes);
+		sendMessage(writer);
+
+		//Recieve ACK_HELLO
+		Node hello_ack;
+		receiveMessage(hello_ack);
+		processHelloAck(hello_ack);
+
+		if (!pipelined)
+		{
+			FrameWriter& needed = encoder();
+			needed.append(needed_data, bytes);
+			sendMessage(needed);
+		}
+
+		//Receive ACK_NEEDED_DATA
+		Node data_ack;
+		receiveMessage(data_ack);
+		processNeededDataAck(data_ack);
+
+		return true;
+	}
+
+	void ClientConnection::sendHello(const char* client_id)
+	{
+		Node hello_message(MsgType_Connecting);
+		hello_message.nodes.push_back(buildHello(client_id));
+		sendMessage(hello_message);
+	}
+
+	Node* ClientConnection::buildHello(const char* client_id)
+	{
+		zusi::Node* hello = new zusi::Node(Cmd_HELLO);
 
 		zusi::Attribute* att = new zusi::Attribute(1);
 		att->setValueUint16(2);
@@ -132,11 +453,11 @@ namespace zusi
 		att->data = new char[4]{ "2.0" };
 		hello->attributes.push_back(att);
 
-		hello_message.write(*m_socket);
+		return hello;
+	}
 
-		//Recieve ACK_HELLO
-		Node hello_ack;
-		receiveMessage(hello_ack);
+	void ClientConnection::processHelloAck(const Node& hello_ack)
+	{
 		if (hello_ack.nodes.size() != 1 || hello_ack.nodes[0]->getId() != Cmd_ACK_HELLO)
 		{
 			throw std::runtime_error("Protocol error - invalid response from server");
@@ -158,11 +479,20 @@ namespace zusi
 				}
 			}
 		}
+	}
 
-		//Send NEEDED_DATA
+	void ClientConnection::sendNeededData(const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung)
+	{
 		Node needed_data_msg(MsgType_Fahrpult);
+		needed_data_msg.nodes.push_back(buildNeededData(fs_data, prog_data, bedienung));
+		sendMessage(needed_data_msg);
+	}
+
+	Node* ClientConnection::buildNeededData(const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung)
+	{
 		Node* needed = new Node(Cmd_NEEDED_DATA);
-		needed_data_msg.nodes.push_back(needed);
+
+		Attribute* att;
 
 		if (!fs_data.empty())
 		{
@@ -191,206 +521,262 @@ namespace zusi
 			}
 		}
 
-		needed_data_msg.write(*m_socket);
+		return needed;
+	}
 
-		//Receive ACK_NEEDED_DATA
-		Node data_ack;
-		receiveMessage(data_ack);
+	void ClientConnection::processNeededDataAck(const Node& data_ack)
+	{
 		if (data_ack.nodes.size() != 1 || data_ack.nodes[0]->getId() != Cmd_ACK_NEEDED_DATA)
 		{
 			throw std::runtime_error("Protocol error - server refused data subscription");
 		}
-
-		return true;
 	}
 
 
 	bool ClientConnection::sendInput(Tastatur taster, TastaturKommand kommand, TastaturAktion aktion, int16_t position)
 	{
-		Node input_message(MsgType_Fahrpult);
-		Node* input = new Node(Cmd_INPUT);
-		input_message.nodes.push_back(input);
+		//Encoded directly rather than through a Node tree, so sending does not allocate
+		FrameWriter& writer = encoder();
+		writer.beginNode(MsgType_Fahrpult);
+		writer.beginNode(Cmd_INPUT);
+		writer.beginNode(1);
+
+		//Tasterzuordnung, Kommand, Aktion, Position
+		writer.attrU16(1, static_cast<uint16_t>(taster));
+		writer.attrU16(2, static_cast<uint16_t>(kommand));
+		writer.attrU16(3, static_cast<uint16_t>(aktion));
+		writer.attrI16(4, position);
+		//'Spezielle funktion parameter'
+		writer.attrFloat(5, position);
+
+		writer.endNode();
+		writer.endNode();
+		writer.endNode();
+
+		return sendMessage(writer);
+	}
+
+	ServerConnection::ServerConnection(Socket* socket) : Connection(socket), m_bedienung(false)
+	{
+	}
 
-		Node* action = new Node(1);
-		input->nodes.push_back(action);
+	ServerConnection::~ServerConnection()
+	{
+	}
 
-		//Tasterzuordnung
-		Attribute* att = new Attribute(1);
-		att->setValueUint16(taster);
-		action->attributes.push_back(att);
+	bool ServerConnection::accept()
+	{
+		//Recieve HELLO
+		Node hello_msg;
+		receiveMessage(hello_msg);
+		processHello(hello_msg);
 
-		//Kommand
-		att = new Attribute(2);
-		att->setValueUint16(kommand);
-		action->attributes.push_back(att);
+		//A pipelining client has already sent NEEDED_DATA - answer both at once
+		if (dataAvailable())
+		{
+			Node needed_data_msg;
+			receiveMessage(needed_data_msg);
+			processNeededData(needed_data_msg);
 
-		//Aktion
-		att = new Attribute(3);
-		att->setValueUint16(aktion);
-		action->attributes.push_back(att);
+			Node hello_ack_message(MsgType_Connecting);
+			hello_ack_message.nodes.push_back(buildHelloAck());
+			Node data_ack_message(MsgType_Fahrpult);
+			data_ack_message.nodes.push_back(buildNeededDataAck());
+			return sendMessages({ &hello_ack_message, &data_ack_message });
+		}
 
-		//Position
-		att = new Attribute(4);
-		att->setValueInt16(position);
-		action->attributes.push_back(att);
+		sendHelloAck();
 
-		//'Spezielle funktion parameter'
-		att = new Attribute(5);
-		float* empty_float = new float(position);
-		att->data = empty_float;
-		att->data_bytes = sizeof(empty_float);
-		action->attributes.push_back(att);
+		//Receive NEEDED_DATA
+		Node needed_data_msg;
+		receiveMessage(needed_data_msg);
+		processNeededData(needed_data_msg);
 
-		return sendMessage(input_message);
+		sendNeededDataAck();
 
+		return true;
 	}
 
-	bool ServerConnection::accept()
+	void ServerConnection::processHello(const Node& hello_msg)
 	{
-		//Recieve HELLO
+		if (hello_msg.nodes.size() != 1 || hello_msg.nodes[0]->getId() != Cmd_HELLO)
 		{
-			Node hello_msg;
-			receiveMessage(hello_msg);
-			if (hello_msg.nodes.size() != 1 || hello_msg.nodes[0]->getId() != Cmd_HELLO)
-			{
-				throw std::runtime_error("Protocol error - invalid HELLO from client");
-			}
-			else
+			throw std::runtime_error("Protocol error - invalid HELLO from client");
+		}
+		else
+		{
+			for (Attribute* att : hello_msg.nodes[0]->attributes)
 			{
-				for (Attribute* att : hello_msg.nodes[0]->attributes)
+				switch (att->getId())
 				{
-					switch (att->getId())
-					{
-					case 3:
-						m_clientName = std::string(static_cast<char*>(att->data), att->data_bytes);
-						break;
-					case 4:
-						m_clientVersion = std::string(static_cast<char*>(att->data), att->data_bytes);
-						break;
-					default:
-						break;
-					}
+				case 3:
+					m_clientName = std::string(static_cast<char*>(att->data), att->data_bytes);
+					break;
+				case 4:
+					m_clientVersion = std::string(static_cast<char*>(att->data), att->data_bytes);
+					break;
+				default:
+					break;
 				}
 			}
 		}
+	}
 
-		//Send hello ack
-		{
-			Node hello_ack_message(MsgType_Connecting);
+	void ServerConnection::sendHelloAck()
+	{
+		Node hello_ack_message(MsgType_Connecting);
+		hello_ack_message.nodes.push_back(buildHelloAck());
+		sendMessage(hello_ack_message);
+	}
 
-			zusi::Node* hello_ack = new zusi::Node(Cmd_ACK_HELLO);
-			hello_ack_message.nodes.push_back(hello_ack);
+	Node* ServerConnection::buildHelloAck()
+	{
+		zusi::Node* hello_ack = new zusi::Node(Cmd_ACK_HELLO);
 
-			zusi::Attribute* att = new zusi::Attribute(1);
-			att->data_bytes = 9;
-			att->data = new char[10]{ "3.1.2.0" };
-			hello_ack->attributes.push_back(att);
+		zusi::Attribute* att = new zusi::Attribute(1);
+		att->data_bytes = 9;
+		att->data = new char[10]{ "3.1.2.0" };
+		hello_ack->attributes.push_back(att);
 
-			att = new zusi::Attribute(2);
-			att->setValueUint8('0');
-			hello_ack->attributes.push_back(att);
+		att = new zusi::Attribute(2);
+		att->setValueUint8('0');
+		hello_ack->attributes.push_back(att);
+
+		att = new zusi::Attribute(3);
+		att->setValueUint8(0);
+		hello_ack->attributes.push_back(att);
 
-			att = new zusi::Attribute(3);
-			att->setValueUint8(0);
-			hello_ack->attributes.push_back(att);
+		return hello_ack;
+	}
 
-			sendMessage(hello_ack_message);
+	void ServerConnection::processNeededData(const Node& needed_data_msg)
+	{
+		if (needed_data_msg.nodes.size() != 1 || needed_data_msg.nodes[0]->getId() != Cmd_NEEDED_DATA)
+		{
+			throw std::runtime_error("Protocol error - invalid NEEDED_DATA from client");
 		}
 
-		//Receive NEEDED_DATA
+		for (const zusi::Node* node : needed_data_msg.nodes[0]->nodes)
 		{
-			Node needed_data_msg;
-			receiveMessage(needed_data_msg);
-			if (needed_data_msg.nodes.size() != 1 || needed_data_msg.nodes[0]->getId() != Cmd_NEEDED_DATA)
+			uint16_t group_id = node->getId();
+
+			if (group_id == 0xB)
 			{
-				throw std::runtime_error("Protocol error - invalid NEEDED_DATA from client");
+				m_bedienung = true;
+				continue;
 			}
 
-			for (const zusi::Node* node : needed_data_msg.nodes[0]->nodes)
+			for (const Attribute* att : node->attributes)
 			{
-				uint16_t group_id = node->getId();
-
-				if (group_id == 0xB)
-				{
-					m_bedienung = true;
+				if (att->getId() != 1 || att->data_bytes != 2)
 					continue;
-				}
 
-				for (const Attribute* att : node->attributes)
-				{
-					if (att->getId() != 1 || att->data_bytes != 2)
-						continue;
+				uint16_t var_id = *(reinterpret_cast<uint16_t*>(att->data));
 
-					uint16_t var_id = *(reinterpret_cast<uint16_t*>(att->data));
-
-					if (group_id == 0xA)
-						m_fs_data.insert(static_cast<zusi::FuehrerstandData>(var_id));
-					else if (group_id == 0xC)
-						m_prog_data.insert(static_cast<zusi::ProgData>(var_id));
+				if (group_id == 0xA)
+				{
+					m_fs_data.insert(static_cast<zusi::FuehrerstandData>(var_id));
+					if (var_id >= m_fs_requested.size())
+						m_fs_requested.resize(var_id + 1);
+					m_fs_requested[var_id] = true;
 				}
-
+				else if (group_id == 0xC)
+					m_prog_data.insert(static_cast<zusi::ProgData>(var_id));
 			}
+
 		}
 
-		//Send ACK_NEEDED_DATA
-		{
-			Node data_ack_message(MsgType_Fahrpult);
+		//The layout of the full state message has changed
+		m_state.reset();
+	}
 
-			zusi::Node* data_ack = new zusi::Node(Cmd_ACK_NEEDED_DATA);
-			data_ack_message.nodes.push_back(data_ack);
+	void ServerConnection::sendNeededDataAck()
+	{
+		Node data_ack_message(MsgType_Fahrpult);
+		data_ack_message.nodes.push_back(buildNeededDataAck());
+		sendMessage(data_ack_message);
+	}
 
-			zusi::Attribute* att = new zusi::Attribute(1);
-			att->setValueUint8(0);
-			data_ack->attributes.push_back(att);
+	Node* ServerConnection::buildNeededDataAck()
+	{
+		zusi::Node* data_ack = new zusi::Node(Cmd_ACK_NEEDED_DATA);
 
-			sendMessage(data_ack_message);
-		}
+		zusi::Attribute* att = new zusi::Attribute(1);
+		att->setValueUint8(0);
+		data_ack->attributes.push_back(att);
 
-		
-		return true;
+		return data_ack;
 	}
 
-	bool ServerConnection::sendData(std::vector<std::pair<FuehrerstandData, float>> ftd_items)
+	bool ServerConnection::sendData(Span<std::pair<FuehrerstandData, float>> ftd_items)
 	{
-		Node data_message(MsgType_Fahrpult);
-
-		zusi::Node* data = new zusi::Node(Cmd_DATA_FTD);
-		data_message.nodes.push_back(data);
+		FrameWriter& writer = encoder();
+		writer.beginNode(MsgType_Fahrpult);
+		writer.beginNode(Cmd_DATA_FTD);
 
-		for (const auto& ftd : ftd_items)
+		bool any = false;
+		for (const std::pair<FuehrerstandData, float>& item : ftd_items)
 		{
-			if (m_fs_data.count(ftd.first) == 1)
+			if (requested(item.first))
 			{
-				Attribute* att = new zusi::Attribute(ftd.first);
-				att->setValueFloat(ftd.second);
-				data->attributes.push_back(att);
+				writer.attrFloat(static_cast<uint16_t>(item.first), item.second);
+				any = true;
 			}
 		}
 
-		if (data->attributes.empty())
+		if (!any)
 			return true;
-			
-		return sendMessage(data_message);
 
+		writer.endNode();
+		writer.endNode();
+		return sendMessage(writer);
 	}
 
-	bool ServerConnection::sendData(std::vector<FsDataItem*> ftd_items)
+	bool ServerConnection::sendData(Span<const FsDataItem*> ftd_items)
 	{
 		if (ftd_items.empty())
 			return true;
 
-		Node data_message(MsgType_Fahrpult);
+		FrameWriter& writer = encoder();
+		writer.beginNode(MsgType_Fahrpult);
+		writer.beginNode(Cmd_DATA_FTD);
+
+		for (const FsDataItem* item : ftd_items)
+			if (requested(item->getId()))
+				item->appendTo(writer);
+
+		writer.endNode();
+		writer.endNode();
+		return sendMessage(writer);
+	}
 
-		zusi::Node* data = new zusi::Node(Cmd_DATA_FTD);
-		data_message.nodes.push_back(data);
+	bool ServerConnection::sendData(Span<FsDataValue> ftd_items)
+	{
+		if (ftd_items.empty())
+			return true;
 
-		for (const auto& item : ftd_items)
-			if(m_fs_data.count(item->getId()) == 1)
-				item->appendTo(*data);
+		FrameWriter& writer = encoder();
+		writer.beginNode(MsgType_Fahrpult);
+		writer.beginNode(Cmd_DATA_FTD);
 
-		return sendMessage(data_message);
+		for (const FsDataValue& item : ftd_items)
+			if (requested(item.getId()))
+				item.appendTo(writer);
 
+		writer.endNode();
+		writer.endNode();
+		return sendMessage(writer);
 	}
 
+	bool ServerConnection::sendState(Span<FsDataValue> changes)
+	{
+		if (!m_state)
+			m_state.reset(new StateFrame(m_fs_data));
+
+		for (const FsDataValue& item : changes)
+			m_state->set(item);
+
+		return sendFrame(m_state->data(), m_state->size());
+	}
 
 }
\ No newline at end of file
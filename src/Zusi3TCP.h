@@ -23,7 +23,14 @@ SOFTWARE.
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <set>
 
@@ -148,6 +155,31 @@ namespace zusi
 		* @return True if data available, otherwise false
 		*/
 		virtual bool DataToRead() = 0;
+
+		/**
+		* @brief Number of bytes which can be read without blocking
+		*
+		* The default implementation only knows whether DataToRead() is true.
+		* @return Byte count, 0 if nothing has arrived, or -1 if the stream has ended
+		*/
+		virtual int BytesAvailable() { return DataToRead() ? 1 : 0; }
+
+		/**
+		* @brief Wait until data arrives or the stream ends
+		*
+		* The default implementation checks DataToRead() at short intervals.
+		* @param timeout Maximum time to wait, may be zero
+		* @return True if BytesAvailable() is now non-zero, false on timeout
+		*/
+		virtual bool WaitReadable(std::chrono::microseconds timeout);
+
+		/**
+		* @brief Send any data held back by WriteBytes()
+		*
+		* Called after each complete message. Sockets which write immediately need not override this.
+		* @return True on success
+		*/
+		virtual bool Flush() { return true; }
 	};
 
 	/**
@@ -249,20 +281,96 @@ namespace zusi
 		uint16_t m_id;
 	};
 
+	/**
+	* @brief Attributes or sub-nodes of a Node which have one ID, in message order
+	*
+	* Returned by Node::equalRangeAttributes() and Node::equalRangeNodes(). Remains
+	* valid while the node is not changed.
+	*/
+	template <typename T>
+	class IdRange
+	{
+	public:
+		class iterator
+		{
+		public:
+			iterator(const std::vector<T*>& items, const uint32_t* entry, size_t pos, uint16_t id) : m_items(&items), m_entry(entry), m_pos(pos), m_id(id)
+			{
+			}
+
+			T* operator*() const { return (*m_items)[m_entry ? (*m_entry & 0xFFFF) : m_pos]; }
+			T* operator->() const { return **this; }
+
+			iterator& operator++()
+			{
+				if (m_entry)
+					++m_entry;
+				else
+					m_pos = IdRange::next(*m_items, m_pos + 1, m_id);
+				return *this;
+			}
+
+			bool operator==(const iterator& o) const { return m_entry == o.m_entry && m_pos == o.m_pos; }
+			bool operator!=(const iterator& o) const { return !(*this == o); }
+
+		private:
+			const std::vector<T*>* m_items;
+			//! Position in the node's index, nullptr when scanning items
+			const uint32_t* m_entry;
+			size_t m_pos;
+			uint16_t m_id;
+		};
+
+		//! Range of index entries, each holding the ID in the high and the position in the low 16 bits
+		IdRange(const std::vector<T*>& items, const uint32_t* first, const uint32_t* last, uint16_t id) :
+			m_begin(items, first, 0, id), m_end(items, last, 0, id)
+		{
+		}
+
+		//! Range found by scanning the items
+		IdRange(const std::vector<T*>& items, uint16_t id) :
+			m_begin(items, nullptr, next(items, 0, id), id), m_end(items, nullptr, items.size(), id)
+		{
+		}
+
+		iterator begin() const { return m_begin; }
+		iterator end() const { return m_end; }
+		bool empty() const { return m_begin == m_end; }
+
+		size_t size() const
+		{
+			size_t count = 0;
+			for (iterator it = m_begin; it != m_end; ++it)
+				++count;
+			return count;
+		}
+
+	private:
+		static size_t next(const std::vector<T*>& items, size_t pos, uint16_t id)
+		{
+			while (pos < items.size() && items[pos]->getId() != id)
+				++pos;
+			return pos;
+		}
+
+		iterator m_begin;
+		iterator m_end;
+	};
+
 	//! Generic Zusi message node
 	class Node
 	{
 	public:
 
 		//! Constructs an empty node
-		Node() : m_id(0)
+		Node() : m_id(0), m_indexedAttributes(0)
 		{
 		}
 
 		/** @brief Constructs an Node
 		* @param id Attribute ID
 		*/
-		Node(uint16_t id) : m_id(id)
+		Node(uint16_t id) : m_id(id), m_indexedAttributes(0)
 		{
 		}
 
@@ -275,21 +383,35 @@ namespace zusi
 				delete n_p;
 		}
 
-		Node(const Node& o) : m_id(o.m_id)
+		Node(const Node& o) : m_id(o.m_id), m_index(o.m_index), m_indexedAttributes(o.m_indexedAttributes)
 		{
-			for (auto it = o.attributes.begin(); it < attributes.end(); ++it)
+			for (auto it = o.attributes.begin(); it < o.attributes.end(); ++it)
 			{
 				attributes.push_back(new Attribute(**it));
 			}
-			for (auto it = o.nodes.begin(); it < nodes.end(); ++it)
+			for (auto it = o.nodes.begin(); it < o.nodes.end(); ++it)
 			{
 				nodes.push_back(new Node(**it));
 			}
 		}
 
+		//! Takes over the attributes and sub-nodes of o, leaving it empty
+		Node(Node&& o) : attributes(std::move(o.attributes)), nodes(std::move(o.nodes)), m_id(o.m_id), m_index(std::move(o.m_index)),
+			m_indexedAttributes(o.m_indexedAttributes)
+		{
+			o.attributes.clear();
+			o.nodes.clear();
+			o.m_index.clear();
+		}
+
 		Node& operator=(const Node& o)
 		{
+			if (this == &o)
+				return *this;
+
 			m_id = o.m_id;
+			m_index = o.m_index;
+			m_indexedAttributes = o.m_indexedAttributes;
 
 			for (Attribute* a_p : attributes)
 				delete a_p;
@@ -300,19 +422,60 @@ namespace zusi
 			attributes.clear();
 			nodes.clear();
 
-			for (auto it = o.attributes.begin(); it < attributes.end(); ++it)
+			for (auto it = o.attributes.begin(); it < o.attributes.end(); ++it)
 				attributes.push_back(new Attribute(**it));
 
-			for (auto it = o.nodes.begin(); it < nodes.end(); ++it)
+			for (auto it = o.nodes.begin(); it < o.nodes.end(); ++it)
 				nodes.push_back(new Node(**it));
 
 			return *this;
 
 		}
 
+		Node& operator=(Node&& o)
+		{
+			if (this == &o)
+				return *this;
+
+			m_id = o.m_id;
+			std::swap(attributes, o.attributes);
+			std::swap(nodes, o.nodes);
+			std::swap(m_index, o.m_index);
+			m_indexedAttributes = o.m_indexedAttributes;
+			return *this;
+		}
+
 		bool write(Socket& sock) const;
 		
-		bool read(Socket& sock);
+		/**
+		* @brief Decode the node from a socket
+		* @param sock Socket positioned after the node's start marker
+		* @param index Build the lookup index of this node and its sub-nodes, see buildIndex()
+		*/
+		bool read(Socket& sock, bool index = false);
+
+		/**
+		* @brief Build a sorted ID index of the attributes and sub-nodes
+		*
+		* Makes findAttribute(), findNode() and the equalRange functions binary searches
+		* instead of scans. Nodes with only a few items are not indexed, as scanning them
+		* is as fast. Build the index again after changing the node; until then, lookups
+		* scan if the number of items changed.
+		* @param recursive Also index all sub-nodes
+		*/
+		void buildIndex(bool recursive = true);
+
+		//! First attribute with ID id, nullptr if there is none
+		Attribute* findAttribute(uint16_t id) const;
+
+		//! First sub-node with ID id, nullptr if there is none
+		Node* findNode(uint16_t id) const;
+
+		//! All attributes with ID id, in message order
+		IdRange<Attribute> equalRangeAttributes(uint16_t id) const;
+
+		//! All sub-nodes with ID id, in message order
+		IdRange<Node> equalRangeNodes(uint16_t id) const;
 
 		//! Get Attribute ID
 		uint16_t getId() const
@@ -326,12 +489,137 @@ namespace zusi
 		std::vector<Node*> nodes;
 
 	private:
+		friend class FrameWriter;
+
+		//! True if the index was built for the current attributes and sub-nodes
+		bool indexed() const;
+
 		uint16_t m_id;
 
+		//! Attribute then sub-node entries, each sorted, with the ID in the high and the position in the low 16 bits
+		std::vector<uint32_t> m_index;
+		size_t m_indexedAttributes;
+
+		//! Nodes with at most this many items are not indexed
+		static const size_t INDEX_MIN_ITEMS = 8;
+
 		static const uint32_t NODE_START = 0;
 		static const uint32_t NODE_END = 0xFFFFFFFF;
 	};
 
+	/**
+	* @brief Read-only view of consecutive elements, e.g. of a std::vector or an array
+	*
+	* The elements are not copied and must remain valid while the span is used.
+	*/
+	template <typename T>
+	class Span
+	{
+	public:
+		Span() : m_data(nullptr), m_size(0)
+		{
+		}
+
+		Span(const T* data, size_t size) : m_data(data), m_size(size)
+		{
+		}
+
+		//! View of a container with data() and size(), e.g. std::vector
+		template <typename Container, typename = typename std::enable_if<std::is_convertible<decltype(std::declval<const Container&>().data()), const T*>::value>::type>
+		Span(const Container& c) : m_data(c.data()), m_size(c.size())
+		{
+		}
+
+		template <size_t N>
+		Span(const T (&array)[N]) : m_data(array), m_size(N)
+		{
+		}
+
+		const T* data() const { return m_data; }
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		const T* begin() const { return m_data; }
+		const T* end() const { return m_data + m_size; }
+		const T& operator[](size_t i) const { return m_data[i]; }
+
+	private:
+		const T* m_data;
+		size_t m_size;
+	};
+
+	/**
+	* @brief Encodes a message straight into a buffer, without building a Node tree
+	*
+	* A message is the root node, so it begins with beginNode() with the MsgType and
+	* ends with the matching endNode(). The buffer keeps its memory when cleared, so
+	* a reused writer stops allocating once it has grown to the largest message.
+	*
+	* @code
+	* writer.beginNode(MsgType_Fahrpult);
+	* writer.beginNode(Cmd_DATA_FTD);
+	* writer.attrFloat(Fs_Geschwindigkeit, 12.5f);
+	* writer.endNode();
+	* writer.endNode();
+	* connection.sendMessage(writer);
+	* @endcode
+	*/
+	class FrameWriter
+	{
+	public:
+		FrameWriter();
+
+		//! Start a node, or a message if no node is open
+		void beginNode(uint16_t id);
+
+		//! End the innermost open node
+		void endNode();
+
+		//! Add a Single attribute to the open node
+		void attrFloat(uint16_t id, float value) { attribute(id, &value, sizeof(value)); }
+
+		//! Add a Word attribute to the open node
+		void attrU16(uint16_t id, uint16_t value) { attribute(id, &value, sizeof(value)); }
+
+		//! Add a SmallInt attribute to the open node
+		void attrI16(uint16_t id, int16_t value) { attribute(id, &value, sizeof(value)); }
+
+		//! Add a Byte attribute to the open node
+		void attrU8(uint16_t id, uint8_t value) { attribute(id, &value, sizeof(value)); }
+
+		//! Add an attribute with arbitrary data to the open node
+		void attrBytes(uint16_t id, Span<char> data) { attribute(id, data.data(), data.size()); }
+
+		//! Add a node and everything it contains
+		void node(const Node& node);
+
+		/**
+		* @brief Add items which are already encoded
+		*
+		* For example a whole pre-encoded message, when no node is open. The data is
+		* copied as it is, so it must be complete nodes and attributes.
+		*/
+		void append(const void* data, size_t bytes);
+
+		//! Number of nodes begun but not ended
+		int depth() const { return m_depth; }
+
+		//! Encoded data
+		const char* data() const { return m_buffer.data(); }
+
+		//! Number of encoded bytes
+		size_t size() const { return m_buffer.size(); }
+
+		//! Discard the encoded data, keeping the memory for the next message
+		void clear();
+
+	private:
+		void attribute(uint16_t id, const void* data, size_t bytes);
+
+		std::vector<char> m_buffer;
+		int m_depth;
+	};
+
 	/** 
 	@brief Represents an piece of data which is sent as part of DATA_FTD message
 
@@ -345,6 +633,22 @@ namespace zusi
 
 		//!Append this data item to the specified node
 		virtual void appendTo(Node& node) const = 0;
+
+		/**
+		* @brief Append this data item to the DATA_FTD node open in writer
+		*
+		* The default implementation goes through appendTo(Node&). Override it to write
+		* directly, without allocating.
+		*/
+		virtual void appendTo(FrameWriter& writer) const
+		{
+			Node node;
+			appendTo(node);
+			for (const Attribute* att : node.attributes)
+				writer.attrBytes(att->getId(), Span<char>(static_cast<const char*>(att->data), att->data_bytes));
+			for (const Node* sub : node.nodes)
+				writer.node(*sub);
+		}
 		virtual bool operator==(const FsDataItem& a) = 0;
 
 		bool operator!=(const FsDataItem& a) {
@@ -381,6 +685,11 @@ namespace zusi
 			node.attributes.push_back(att);
 		}
 
+		virtual void appendTo(FrameWriter& writer) const
+		{
+			writer.attrFloat(static_cast<uint16_t>(getId()), m_value);
+		}
+
 		float m_value;
 	};
 
@@ -437,37 +746,240 @@ namespace zusi
 			node.nodes.push_back(sNode);
 		}
 
+		virtual void appendTo(FrameWriter& writer) const
+		{
+			writer.beginNode(static_cast<uint16_t>(getId()));
+			writer.attrU8(1, '0');
+			writer.attrU8(2, m_licht);
+			writer.attrU8(3, m_hupebrems ? 2 : m_hupewarning ? 1 : 0);
+			writer.attrU8(4, m_hauptschalter + 1);
+			writer.attrU8(5, m_storschalter + 1);
+			writer.attrU8(6, m_luftabsper + 1);
+			writer.endNode();
+		}
+
 		bool m_licht = false, m_hupewarning = false, m_hupebrems = false, m_hauptschalter = true, m_storschalter = true, m_luftabsper = true;
 	};
 
+	//! State of the Sifa sent in the Fs_Sifa structure, with the same defaults as SifaFsDataItem
+	struct SifaState
+	{
+		bool licht = false;
+		bool hupewarning = false;
+		bool hupebrems = false;
+		bool hauptschalter = true;
+		bool storschalter = true;
+		bool luftabsper = true;
+	};
+
+	/**
+	* @brief DATA_FTD item held by value: a float, or a structure such as Fs_Sifa
+	*
+	* Unlike FsDataItem it needs no heap allocation or virtual calls, so a tick's
+	* worth of items can be kept in one std::vector and encoded in a single pass.
+	*/
+	class FsDataValue
+	{
+	public:
+		//! Kinds of item
+		enum Kind
+		{
+			Kind_Float,
+			Kind_Sifa
+		};
+
+		//! Float item
+		FsDataValue(FuehrerstandData id, float value) : m_id(id), m_kind(Kind_Float)
+		{
+			m_value.f = value;
+		}
+
+		//! Fs_Sifa item
+		explicit FsDataValue(const SifaState& sifa) : m_id(Fs_Sifa), m_kind(Kind_Sifa)
+		{
+			m_value.sifa = sifa;
+		}
+
+		//! Returns the Fuehrerstand Data type ID of this data item
+		FuehrerstandData getId() const { return m_id; }
+
+		Kind kind() const { return m_kind; }
+
+		//! Value of a Kind_Float item
+		float valueFloat() const { return m_value.f; }
+
+		//! Value of a Kind_Sifa item
+		const SifaState& valueSifa() const { return m_value.sifa; }
+
+		//! Append this data item to the DATA_FTD node open in writer
+		void appendTo(FrameWriter& writer) const
+		{
+			switch (m_kind)
+			{
+			case Kind_Float:
+				writer.attrFloat(static_cast<uint16_t>(m_id), m_value.f);
+				break;
+			case Kind_Sifa:
+				writer.beginNode(static_cast<uint16_t>(m_id));
+				writer.attrU8(1, '0');
+				writer.attrU8(2, m_value.sifa.licht);
+				writer.attrU8(3, m_value.sifa.hupebrems ? 2 : m_value.sifa.hupewarning ? 1 : 0);
+				writer.attrU8(4, m_value.sifa.hauptschalter + 1);
+				writer.attrU8(5, m_value.sifa.storschalter + 1);
+				writer.attrU8(6, m_value.sifa.luftabsper + 1);
+				writer.endNode();
+				break;
+			}
+		}
+
+		bool operator==(const FsDataValue& a) const
+		{
+			if (m_id != a.m_id || m_kind != a.m_kind)
+				return false;
+
+			switch (m_kind)
+			{
+			case Kind_Float:
+				return m_value.f == a.m_value.f;
+			case Kind_Sifa:
+				return m_value.sifa.licht == a.m_value.sifa.licht
+					&& m_value.sifa.hupewarning == a.m_value.sifa.hupewarning
+					&& m_value.sifa.hupebrems == a.m_value.sifa.hupebrems
+					&& m_value.sifa.hauptschalter == a.m_value.sifa.hauptschalter
+					&& m_value.sifa.storschalter == a.m_value.sifa.storschalter
+					&& m_value.sifa.luftabsper == a.m_value.sifa.luftabsper;
+			}
+			return false;
+		}
+
+		bool operator!=(const FsDataValue& a) const
+		{
+			return !(*this == a);
+		}
+
+	private:
+		FuehrerstandData m_id;
+		Kind m_kind;
+		//! Named so it can have a constructor, which SifaState's defaults require
+		union Value
+		{
+			Value() : f(0.0f)
+			{
+			}
+
+			float f;
+			SifaState sifa;
+		} m_value;
+	};
+
+
+	class FrameBuffer;
+	class FrameReader;
+	class StateFrame;
 
 	//! Parent class for a connection
 	class Connection
 	{
 	public:
+		//! Result of receiving with a deadline
+		enum ReceiveStatus
+		{
+			Receive_Message,
+			Receive_Timeout,
+			Receive_Closed
+		};
+
 		/**
 		* @brief Create connection which will communicate over socket
 		* @param socket The socket - class does not take ownership of it
 		*/
-		Connection(Socket* socket) : m_socket(socket)
-		{
-		}
+		Connection(Socket* socket);
 
-		virtual ~Connection()
-		{
-		}
+		virtual ~Connection();
 
 		//! Receive a message
 		bool receiveMessage(Node& dest) const;
 
+		/**
+		* @brief Receive a message, giving up at a deadline
+		*
+		* Reads only what has arrived, so the call returns by the deadline even when
+		* the peer has sent part of a message. The part is kept for the next call.
+		* Use the Socket's WaitReadable() granularity as a guide for how close to the
+		* deadline the call returns.
+		*
+		* @param dest Empty node to decode into
+		* @param deadline Time at which to stop waiting. A time in the past only takes data which has already arrived.
+		* @throws std::runtime_error if the received data is not a valid message
+		*/
+		ReceiveStatus receiveMessage(Node& dest, std::chrono::steady_clock::time_point deadline) const;
+
+		/**
+		* @brief Receive a message if one has arrived completely, without waiting
+		* @param dest Empty node to decode into
+		* @throws std::runtime_error if the received data is not a valid message
+		*/
+		ReceiveStatus pollMessage(Node& dest) const { return receiveMessage(dest, std::chrono::steady_clock::time_point::min()); }
+
+		/**
+		* @brief Receive a message without decoding it into a Node
+		*
+		* The message stays in the connection's receive buffer, which is reused, so once
+		* the buffer has grown to the largest message no memory is allocated.
+		* @param dest Reader for the message, valid until the next receive call
+		* @return True on success, false if the connection was closed
+		* @throws std::runtime_error if the received data is not a valid message
+		*/
+		bool receiveFrame(FrameReader& dest) const;
+
+		/**
+		* @brief Receive a message without decoding it, giving up at a deadline
+		* @see receiveFrame(FrameReader&) and receiveMessage(Node&, std::chrono::steady_clock::time_point)
+		*/
+		ReceiveStatus receiveFrame(FrameReader& dest, std::chrono::steady_clock::time_point deadline) const;
+
 		//! Send a message
 		bool sendMessage(Node& src);
 
+		//! Send a message encoded with a FrameWriter
+		bool sendMessage(const FrameWriter& src);
+
+		/**
+		* @brief Send a message which is already encoded
+		* @param frame Message including the message header
+		* @param bytes Size of the message
+		*/
+		bool sendFrame(const void* frame, size_t bytes);
+
+		/**
+		* @brief Send several messages with a single write to the socket
+		* @param messages Messages to send, in order
+		* @return True on success
+		*/
+		bool sendMessages(const std::vector<const Node*>& messages);
+
 		//! Check if there is data read
 		bool dataAvailable() { return m_socket->DataToRead(); }
 
 	protected:
+		/**
+		* @brief Empty writer for encoding a message to send
+		*
+		* The writer belongs to the calling thread and keeps its memory, so encoding
+		* does not allocate once it has grown to the largest message.
+		*/
+		static FrameWriter& encoder();
+
 		Socket* m_socket;
+
+	private:
+		//! Wait until a complete message is at the front of m_received
+		ReceiveStatus nextFrame(std::chrono::steady_clock::time_point deadline) const;
+
+		//! Data received by the timed functions which does not form a complete message yet
+		mutable std::unique_ptr<FrameBuffer> m_received;
+		//! Length of the message handed out by receiveFrame(), removed by the next receive
+		mutable size_t m_frameBytes;
 	};
 
 	//! Manages connection to a Zusi server
@@ -487,13 +999,59 @@ namespace zusi
 		* 
 		* Sends the HELLO and NEEDED_DATA commands and processes the results
 		*
+		* In pipelined mode HELLO and NEEDED_DATA are sent together in one write,
+		* without waiting for ACK_HELLO in between, which saves one round trip.
+		*
 		* @param client_id Null-terminated character array with an identification string for the client
 		* @param fs_data Fuehrerstand Data ID's to subscribe to
 		* @param prog_data Zusi program status ID's to subscribe to
 		* @param bedienung Subscribe to input events if true
+		* @param pipelined Send NEEDED_DATA before ACK_HELLO has been received
+		* @return True on success
+		*/
+		bool connect(const char* client_id, const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung, bool pipelined = false);
+
+		/**
+		* @brief Set up connection to server with an encoded NEEDED_DATA message
+		*
+		* As above, but the subscription is sent as given, e.g. Subscription::NEEDED_DATA
+		* @param client_id Null-terminated character array with an identification string for the client
+		* @param needed_data NEEDED_DATA message including the message header
+		* @param bytes Size of needed_data
+		* @param pipelined Send NEEDED_DATA before ACK_HELLO has been received
 		* @return True on success
 		*/
-		bool connect(const char* client_id, const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung);
+		bool connect(const char* client_id, const void* needed_data, size_t bytes, bool pipelined = false);
+
+		/**
+		* @brief Send the HELLO command
+		*
+		* First step of connect(), for use when the answer is received by other means (e.g. EpollReactor)
+		* @param client_id Null-terminated character array with an identification string for the client
+		*/
+		void sendHello(const char* client_id);
+
+		/**
+		* @brief Process the server's answer to HELLO
+		* @param msg Received message
+		* @throws std::runtime_error if the message is not ACK_HELLO
+		*/
+		void processHelloAck(const Node& msg);
+
+		/**
+		* @brief Send the NEEDED_DATA command
+		* @param fs_data Fuehrerstand Data ID's to subscribe to
+		* @param prog_data Zusi program status ID's to subscribe to
+		* @param bedienung Subscribe to input events if true
+		*/
+		void sendNeededData(const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung);
+
+		/**
+		* @brief Process the server's answer to NEEDED_DATA
+		* @param msg Received message
+		* @throws std::runtime_error if the message is not ACK_NEEDED_DATA
+		*/
+		void processNeededDataAck(const Node& msg);
 
 		/** 
 		* @brief Send an INPUT command 
@@ -514,6 +1072,9 @@ namespace zusi
 		}
 
 	private:
+		static Node* buildHello(const char* client_id);
+		static Node* buildNeededData(const std::vector<FuehrerstandData>& fs_data, const std::vector<ProgData>& prog_data, bool bedienung);
+
 		std::string m_zusiVersion;
 		std::string m_connectionInfo;
 
@@ -523,30 +1084,71 @@ namespace zusi
 	class ServerConnection : public Connection
 	{
 	public:
-		ServerConnection(Socket* socket) : Connection(socket), m_bedienung(false)
-		{
-		}
+		ServerConnection(Socket* socket);
 
-		virtual ~ServerConnection()
-		{
-		}
+		virtual ~ServerConnection();
 
-		//! Run connection handshake with client
+		/**
+		* @brief Run connection handshake with client
+		*
+		* If the client has pipelined NEEDED_DATA behind HELLO, both acknowledgements
+		* are sent together in one write.
+		*/
 		bool accept();
 
+		/**
+		* @brief Process the client's HELLO
+		*
+		* First step of accept(), for use when messages are received by other means
+		* @param msg Received message
+		* @throws std::runtime_error if the message is not HELLO
+		*/
+		void processHello(const Node& msg);
+
+		//! Send the ACK_HELLO command
+		void sendHelloAck();
+
+		/**
+		* @brief Process the client's NEEDED_DATA and store the subscription
+		* @param msg Received message
+		* @throws std::runtime_error if the message is not NEEDED_DATA
+		*/
+		void processNeededData(const Node& msg);
+
+		//! Send the ACK_NEEDED_DATA command
+		void sendNeededDataAck();
+
+		/**
+		* @brief Send FuehrerstandData updates to the client
+		*
+		* Only data that was requested by the client will actually be sent
+		*/
+		bool sendData(Span<std::pair<FuehrerstandData, float>> ftd_items);
+
 		/**
 		* @brief Send FuehrerstandData updates to the client
 		*
 		* Only data that was requested by the client will actually be sent
 		*/
-		bool sendData(std::vector<std::pair<FuehrerstandData, float>> ftd_items);
+		bool sendData(Span<const FsDataItem*> ftd_items);
 
 		/**
 		* @brief Send FuehrerstandData updates to the client
 		*
 		* Only data that was requested by the client will actually be sent
 		*/
-		bool sendData(std::vector<FsDataItem*> ftd_items);
+		bool sendData(Span<FsDataValue> ftd_items);
+
+		/**
+		* @brief Send every variable requested by the client, with the given values updated
+		*
+		* The message is encoded once per connection, with a place for each variable
+		* (see StateFrame). Each call only overwrites the given values in it and sends
+		* it, so variables not given keep the value sent last time. Items which were
+		* not requested are ignored.
+		* @throws std::runtime_error if Fs_Sifa is given as a float, or another variable as Sifa structure
+		*/
+		bool sendState(Span<FsDataValue> changes);
 
 		//! Get the version string supplied by the client
 		std::string getClientVersion()
@@ -560,14 +1162,47 @@ namespace zusi
 			return m_clientName;
 		}
 
+		//! Fuehrerstand Data ID's requested by the client
+		const std::set<FuehrerstandData>& getFuehrerstandData() const
+		{
+			return m_fs_data;
+		}
+
+		//! Program status ID's requested by the client
+		const std::set<ProgData>& getProgData() const
+		{
+			return m_prog_data;
+		}
+
+		//! True if the client requested input events
+		bool getBedienung() const
+		{
+			return m_bedienung;
+		}
+
 	private:
+		static Node* buildHelloAck();
+		static Node* buildNeededDataAck();
+
 		std::string m_clientVersion;
 		std::string m_clientName;
 
+		//! True if the client requested a FuehrerstandData, indexed by ID
+		bool requested(FuehrerstandData id) const
+		{
+			size_t index = static_cast<size_t>(id);
+			return index < m_fs_requested.size() && m_fs_requested[index];
+		}
+
 		std::set<FuehrerstandData> m_fs_data;
+		//! m_fs_data as a table, for looking up every item sent
+		std::vector<bool> m_fs_requested;
 		std::set<ProgData> m_prog_data;
 		bool m_bedienung;
 
+		//! Message sent by sendState(), built on first use
+		std::unique_ptr<StateFrame> m_state;
+
 	};
 
 }